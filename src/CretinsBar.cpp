@@ -7,8 +7,13 @@
 
 #include "CretinsBar.h"
 #include "Engine.h"
+#include "StageTimings.h"
+#include "Tracer.h"
 #include "GUI/MainWindow.h"
 
+#include <QProcessEnvironment>
+#include <QDebug>
+
 namespace cb {
 
 CretinsBar::CretinsBar(int &argc, char **argv) :
@@ -19,6 +24,9 @@ CretinsBar::CretinsBar(int &argc, char **argv) :
 	setApplicationName("CretinsBar");
 	setApplicationVersion("alpha");
 
+	// CRETINSBAR_TRACE=file.json records a trace of the whole session, saved on exit
+	if(!QProcessEnvironment::systemEnvironment().value("CRETINSBAR_TRACE").isEmpty()) Tracer::shared().start();
+
 	_window->show();
 
 	if(argc > 1) {
@@ -28,7 +36,29 @@ CretinsBar::CretinsBar(int &argc, char **argv) :
 }
 
 CretinsBar::~CretinsBar() {
+	QString trace = QProcessEnvironment::systemEnvironment().value("CRETINSBAR_TRACE");
+	if(!trace.isEmpty()) {
+		Tracer::shared().stop();
+		try {
+			Tracer::shared().save(trace);
+		}
+		catch(std::exception &e) {
+			qCritical() << e.what();
+		}
+	}
 
+	// CRETINSBAR_TIMINGS=log prints the time spent in each stage to the log, while any other value is used as the
+	// name of the JSON file the timings are written to
+	QString timings = QProcessEnvironment::systemEnvironment().value("CRETINSBAR_TIMINGS");
+	if(timings == "log") StageTimings::shared().dump_to_log();
+	else if(!timings.isEmpty()) {
+		try {
+			StageTimings::shared().dump_to_file(timings);
+		}
+		catch(std::exception &e) {
+			qCritical() << e.what();
+		}
+	}
 }
 
 } /* namespace cb */
@@ -7,17 +7,23 @@
 
 #include "Engine.h"
 
+#include "Renderer.h"
 #include "SoundUtils/SoundUtils.h"
+#include "SoundUtils/Mp3Decoder.h"
+#include "SoundUtils/Mp3Source.h"
+#include "SoundUtils/Mp3Stream.h"
 #include "SoundUtils/Wave.h"
+#include "StageTimings.h"
+#include "Tracer.h"
 
 #include <QAudioOutput>
 #include <QFile>
 #include <QAudioFormat>
 #include <QFileInfo>
+#include <QCoreApplication>
+
+#include <algorithm>
 
-#ifndef NOMP3
-#include <mpg123.h>
-#endif
 
 namespace cb {
 
@@ -25,76 +31,218 @@ Engine::Engine(QObject *parent) :
 				QObject(parent),
 				_audio_output_device(QAudioDeviceInfo::defaultOutputDevice()),
 				_audio_output(nullptr),
+				_lazy_decoding_us(DEFAULT_LAZY_DECODING_US),
 				_start_from_time(0),
 				_end_at_time(-1),
 				_play_time(0),
 				_volume(1.0),
 				_curr_tempo_change(0.0),
-				_curr_pitch_change(0) {
-
+				_curr_pitch_change(0),
+				_renderer(new Renderer),
+				_is_processing(false),
+				_processing_start_us(0),
+				_processing_end_us(0),
+				_render_selection_only(true),
+				_has_selection(false),
+				_speculative_renderer(new Renderer(std::max(1, QThread::idealThreadCount() / 2), "speculative_process")),
+				_is_speculating(false),
+				_looping(false),
+				_loop_crossfade_us(0) {
+	_render_thread.setObjectName("render");
+	_speculation_thread.setObjectName("speculation");
+
+	_renderer->moveToThread(&_render_thread);
+	connect(&_render_thread, &QThread::finished, _renderer, &QObject::deleteLater);
+	connect(_renderer, &Renderer::progress, this, &Engine::processing_progress);
+	connect(_renderer, &Renderer::rendered, this, &Engine::_on_rendered);
+	_render_thread.start();
+
+	_speculative_renderer->moveToThread(&_speculation_thread);
+	connect(&_speculation_thread, &QThread::finished, _speculative_renderer, &QObject::deleteLater);
+	connect(_speculative_renderer, &Renderer::rendered, this, &Engine::_on_speculated);
+	_speculation_thread.start(QThread::LowPriority);
 }
 
 Engine::~Engine() {
+	// the device must stop reading from the source before the latter is destroyed
+	_audio_output_IO_device.set_source(nullptr);
+	_renderer->cancel();
+	_speculative_renderer->cancel();
+	_render_thread.quit();
+	_speculation_thread.quit();
+	_render_thread.wait();
+	_speculation_thread.wait();
+}
 
+std::shared_ptr<Wave> Engine::_load_wave(const QString &filename) {
+	StageTimer timer("load_wave");
+	std::shared_ptr<Wave> wave(new Wave(filename));
+	timer.set_processed(wave->get_data_size(), wave->get_n_samples(), wave->duration_us());
+
+	return wave;
 }
 
-void Engine::_load_wave(const QString &filename) {
-	_wav_file = std::unique_ptr<Wave>(new Wave(filename));
+std::shared_ptr<Wave> Engine::_load_mp3(const QString &filename) {
+	StageTimer timer("load_mp3");
+	std::shared_ptr<Wave> wave;
+	try {
+		wave = Mp3Decoder::decode_wave(filename);
+	}
+	catch(std::exception &e) {
+		timer.discard();
+		QString error = QString("Cannot decode '%1': %2").arg(filename).arg(e.what());
+		throw std::runtime_error(error.toStdString());
+	}
+	timer.set_processed(wave->get_data_size(), wave->get_n_samples(), wave->duration_us());
+
+	return wave;
 }
 
-// TODO: mpg123_init() and mpg123_exit() could be moved to the costructor and the destructor if their presence
-// here has a too big impact on performance
-void Engine::_load_mp3(const QString &filename) {
-#ifndef NOMP3
-	mpg123_init();
-
-	int m_err;
-	mpg123_handle *mh = mpg123_new(NULL, &m_err);
-	size_t buffer_size = mpg123_outblock(mh);
-	int m_res = mpg123_open(mh, filename.toStdString().c_str());
-	if(m_res == MPG123_OK) {
-		int channels, encoding;
-		long rate;
-		mpg123_getformat(mh, &rate, &channels, &encoding);
-
-		// encsize returns the size in bytes
-		int bits = mpg123_encsize(encoding)*8;
-		_wav_file = std::unique_ptr<Wave>(new Wave(channels, rate, bits));
-
-		size_t done;
-		unsigned char *buffer = new unsigned char[buffer_size];
-		while (mpg123_read(mh, buffer, buffer_size, &done) == MPG123_OK) {
-			_wav_file->append_samples((char *) buffer, buffer_size);
-		}
+std::shared_ptr<SampleStore> Engine::_load_mp3_samples(const QString &filename, int n_threads) {
+	StageTimer timer("load_mp3");
+	std::shared_ptr<SampleStore> samples;
+	try {
+		samples = Mp3Decoder::decode(filename, n_threads);
+	}
+	catch(std::exception &e) {
+		timer.discard();
+		QString error = QString("Cannot decode '%1': %2").arg(filename).arg(e.what());
+		throw std::runtime_error(error.toStdString());
+	}
+	timer.set_processed(samples->size(), samples->n_samples(), samples->duration_us());
+
+	return samples;
+}
 
-		mpg123_close(mh);
-		mpg123_delete(mh);
+std::shared_ptr<SampleSource> Engine::_open_mp3_source(const QString &filename) {
+	StageTimer timer("index_mp3");
+	std::shared_ptr<SampleSource> source;
+	try {
+		source = std::make_shared<Mp3Source>(filename);
 	}
+	catch(std::exception &e) {
+		timer.discard();
+		QString error = QString("Cannot decode '%1': %2").arg(filename).arg(e.what());
+		throw std::runtime_error(error.toStdString());
+	}
+	timer.set_processed(QFileInfo(filename).size(), source->n_samples(), source->duration_us());
+
+	return source;
+}
 
-	mpg123_exit();
+bool Engine::_decodes_lazily(const QString &filename) {
+#ifndef NOMP3
+	if(_lazy_decoding_us < 0 || QFileInfo(filename).completeSuffix() != "mp3") return false;
+	// blocks are decoded straight to floats: without float output, files are decoded whole as 16-bit waves
+	if(!Mp3Stream::supports_float()) return false;
+
+	try {
+		// the estimated length is enough to decide, and it does not require scanning the file
+		Mp3Stream stream(filename, Mp3Stream::INT16);
+		return stream.length() > 0 && stream.length() * 1000000 / stream.sample_rate() >= _lazy_decoding_us;
+	}
+	catch(std::exception &) {
+		// the error is reported when the file is decoded
+		return false;
+	}
+#else
+	Q_UNUSED(filename);
+	return false;
 #endif
 }
 
-void Engine::load(const QString &filename) {
-	_reset();
+std::shared_ptr<Wave> Engine::_output_wave(const SampleStore &samples) {
+	StageTimer timer("convert_output");
+	std::shared_ptr<Wave> wave = std::make_shared<Wave>(samples.channels(), samples.sample_rate(), SoundUtils::OUTPUT_BITS_PER_SAMPLE);
+	wave->append_samples(samples.samples(0, samples.n_samples()), samples.n_samples());
+	timer.set_processed(wave->get_data_size(), wave->get_n_samples(), wave->duration_us());
+
+	return wave;
+}
+
+std::shared_ptr<Wave> Engine::decode(const QString &filename) {
+	QJsonObject args;
+	args["file"] = filename;
+	TraceSpan span("io", "decode", args);
+
+	QString extension = QFileInfo(filename).completeSuffix();
+
+	if(extension == "wav") return _load_wave(filename);
+#ifndef NOMP3
+	else if(extension == "mp3") return _load_mp3(filename);
+#endif
+
+	QString error = QString("Unsupported file extension '%1'").arg(extension);
+	throw std::runtime_error(error.toStdString());
+}
+
+std::shared_ptr<SampleStore> Engine::decode_samples(const QString &filename, int n_threads) {
+	QJsonObject args;
+	args["file"] = filename;
+	TraceSpan span("io", "decode_samples", args);
 
 	QString extension = QFileInfo(filename).completeSuffix();
 
-	if(extension == "wav") _load_wave(filename);
 #ifndef NOMP3
-	else if(extension == "mp3") _load_mp3(filename);
+	if(extension == "mp3") return _load_mp3_samples(filename, n_threads);
 #endif
+
+	std::shared_ptr<Wave> wave = decode(filename);
+	StageTimer timer("convert");
+	std::shared_ptr<SampleStore> samples = std::make_shared<SampleStore>(*wave);
+	timer.set_processed(samples->size(), samples->n_samples(), samples->duration_us());
+
+	return samples;
+}
+
+void Engine::load(const QString &filename) {
+	StageTimer timer("load");
+	_reset();
+
+	if(_decodes_lazily(filename)) {
+		// nothing is decoded until it is needed, hence there is no wave to play as it is
+		_samples = _open_mp3_source(filename);
+		_wav_file = nullptr;
+		_original = nullptr;
+		timer.set_processed(QFileInfo(filename).size(), _samples->n_samples(), _samples->duration_us());
+	}
 	else {
-		QString error = QString("Unsupported file extension '%1'").arg(extension);
-		throw std::runtime_error(error.toStdString());
+		std::shared_ptr<SampleStore> samples;
+		if(QFileInfo(filename).completeSuffix() == "wav") {
+			_wav_file = decode(filename);
+			if(!_wav_file->is_mapped()) {
+				StageTimer convert_timer("convert");
+				samples = std::make_shared<SampleStore>(*_wav_file);
+				convert_timer.set_processed(samples->size(), samples->n_samples(), samples->duration_us());
+			}
+		}
+		else {
+			// compressed files are decoded straight to floats, and the wave is built from them
+			samples = decode_samples(filename);
+			_wav_file = _output_wave(*samples);
+		}
+		timer.set_processed(_wav_file->get_data_size(), _wav_file->get_n_samples(), _wav_file->duration_us());
+
+		// the renditions are 16-bit whatever the format of the file. A mapped file in another format is not copied:
+		// like audio that is decoded lazily, it is stretched on the fly even when tempo and pitch are unchanged
+		if(_wav_file->codec().format() == SampleCodec::INT16) _original = _wav_file;
+		else if(samples) _original = _output_wave(*samples);
+		else _original = nullptr;
+
+		// a mapped file decodes its samples as they are read
+		if(samples) _samples = samples;
+		else _samples = _wav_file;
 	}
 
-	_audio_format = _wav_file->format();
+	// the audio output plays the renditions
+	_audio_format = Wave(_samples->channels(), _samples->sample_rate(), SoundUtils::OUTPUT_BITS_PER_SAMPLE).format();
 
-	_out_file = std::unique_ptr<Wave>(new Wave(*_wav_file));
+	_cache.clear();
 
-	_audio_output_IO_device.setBuffer(_out_file->data());
-	_audio_output_IO_device.open(QIODevice::ReadOnly);
+	_audio_output_IO_device.set_source(_samples.get());
+	_audio_output_IO_device.set_parameters(_curr_tempo_change, _curr_pitch_change);
+	// the device must not be buffered, or stale samples would be played after a seek or a change of parameters
+	_audio_output_IO_device.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
 
 	_audio_output = new QAudioOutput(_audio_output_device, _audio_format, this);
 	_audio_output->setNotifyInterval(10);
@@ -104,21 +252,83 @@ void Engine::load(const QString &filename) {
 	set_boundaries(0, -1);
 }
 
-const QByteArray *Engine::data() {
-	return _out_file->data();
+void Engine::set_lazy_decoding(qint64 min_duration_us) {
+	_lazy_decoding_us = min_duration_us;
+}
+
+const char *Engine::data() {
+	return _wav_file ? _wav_file->data() : nullptr;
+}
+
+std::shared_ptr<const Wave> Engine::wave() {
+	return _wav_file;
+}
+
+std::shared_ptr<const SampleSource> Engine::source() {
+	return _samples;
 }
 
 void Engine::set_boundaries(qint64 start_us, qint64 end_us) {
 	if(is_ready()) {
 		stop();
+		// speculative processing of the old region is of no use
+		_cancel_speculation();
 
-		_seek_buffer(start_us);
 		_start_from_time = start_us;
 		_end_at_time = (end_us > 0) ? end_us : duration()*1000000;
+		_has_selection = (end_us > 0);
+
+		qint64 from_us, to_us;
+		_required_region(from_us, to_us);
+		_update_rendition(from_us, to_us);
+
+		_audio_output_IO_device.set_boundaries(_start_from_time, _end_at_time);
+		_seek_buffer(start_us);
 		emit play_position_changed(_start_from_time);
 	}
 }
 
+void Engine::set_cache_budget(qint64 bytes) {
+	_cache.set_budget(bytes);
+}
+
+void Engine::set_render_selection_only(bool enabled) {
+	_render_selection_only = enabled;
+	if(is_ready()) {
+		qint64 from_us, to_us;
+		_required_region(from_us, to_us);
+		_update_rendition(from_us, to_us);
+	}
+}
+
+void Engine::set_speculative_candidates(const std::vector<std::pair<qreal, int>> &candidates) {
+	_speculative_candidates = candidates;
+
+	if(_is_speculating) {
+		auto it = std::find(_speculative_candidates.begin(), _speculative_candidates.end(), _speculating_candidate);
+		if(it == _speculative_candidates.end()) _cancel_speculation();
+	}
+	_speculate_next();
+}
+
+void Engine::set_buffer_watermarks(qint64 low_us, qint64 high_us) {
+	_audio_output_IO_device.set_watermarks(low_us, high_us);
+}
+
+int Engine::underrun_count() {
+	return _audio_output_IO_device.underrun_count();
+}
+
+void Engine::set_looping(bool enabled) {
+	_looping = enabled;
+	_audio_output_IO_device.set_looping(_looping, _loop_crossfade_us);
+}
+
+void Engine::set_loop_crossfade(qint64 crossfade_us) {
+	_loop_crossfade_us = crossfade_us;
+	_audio_output_IO_device.set_looping(_looping, _loop_crossfade_us);
+}
+
 void Engine::set_volume(qreal new_volume) {
 	if(is_ready() && new_volume > 0. && new_volume <= 1.0) _audio_output->setVolume(new_volume);
 }
@@ -140,7 +350,7 @@ QAudioFormat::SampleType Engine::sample_type() {
 }
 
 qreal Engine::duration() {
-	if(is_ready()) return _wav_file->duration();
+	if(is_ready()) return _samples->n_samples() / (qreal) (_samples->sample_rate() * _samples->channels());
 	else return 0.;
 }
 
@@ -152,10 +362,17 @@ bool Engine::is_ready() {
 	return _audio_output != nullptr;
 }
 
+bool Engine::is_processing() {
+	return _is_processing;
+}
+
 void Engine::export_all(QString filename) {
 	QString extension = QFileInfo(filename).completeSuffix();
 	if(extension == "wav") {
-		_out_file->save(filename);
+		StageTimer timer("export_all");
+		std::shared_ptr<Wave> out_wave = _processed_file(0, _samples->duration_us()).wave;
+		out_wave->save(filename);
+		timer.set_processed(out_wave->get_data_size(), out_wave->get_n_samples(), _samples->duration_us());
 	}
 	else {
 		QString error = QString("Unsupported file extension '%1'").arg(extension);
@@ -168,14 +385,17 @@ void Engine::export_selection(QString filename) {
 
 	QString extension = QFileInfo(filename).completeSuffix();
 	if(extension == "wav") {
-		Wave selection_wave = Wave((int) _out_file->get_channels(), _out_file->get_samples_per_sec(), _out_file->get_bits_per_sample());
+		StageTimer timer("export_selection");
+		Rendition out_file = _processed_file(_start_from_time, _end_at_time);
+		Wave selection_wave = Wave((int) out_file.wave->get_channels(), out_file.wave->get_samples_per_sec(), out_file.wave->get_bits_per_sample());
 
-		qint64 first_byte = _out_file->bytes_from_us(_from_original_to_real_time(_start_from_time));
-		qint64 last_byte = _out_file->bytes_from_us(_from_original_to_real_time(_end_at_time));
+		qint64 first_byte = out_file.byte_offset(_start_from_time);
+		qint64 last_byte = out_file.byte_offset(_end_at_time);
 		qint64 byte_size = last_byte - first_byte;
-		selection_wave.append_samples(_out_file->data()->data() + first_byte, byte_size);
+		selection_wave.append_samples(out_file.wave->data() + first_byte, byte_size);
 
 		selection_wave.save(filename);
+		timer.set_processed(byte_size, selection_wave.get_n_samples(), _end_at_time - _start_from_time);
 	}
 	else {
 		QString error = QString("Unsupported file extension '%1'").arg(extension);
@@ -184,9 +404,17 @@ void Engine::export_selection(QString filename) {
 }
 
 void Engine::_reset() {
+	cancel_processing();
+	_cancel_speculation();
+	_out_file = Rendition();
+	_curr_tempo_change = 0.;
+	_curr_pitch_change = 0;
+	_has_selection = false;
+
 	if(is_ready()) {
 		_audio_output->stop();
 		_audio_output_IO_device.close();
+		_audio_output_IO_device.set_source(nullptr);
 		delete _audio_output;
 		_audio_output = nullptr;
 	}
@@ -197,13 +425,7 @@ void Engine::_reset() {
 
 void Engine::play(qreal tempo_change, int pitch_change) {
 	if(is_ready() && _audio_output->state() != QAudio::ActiveState) {
-		if(tempo_change != _curr_tempo_change || pitch_change != _curr_pitch_change) {
-			stop();
-			_curr_tempo_change = tempo_change;
-			_curr_pitch_change = pitch_change;
-			_process(tempo_change, pitch_change);
-			_seek_buffer(_play_time);
-		}
+		set_parameters(tempo_change, pitch_change);
 
 		if(_audio_output_IO_device.atEnd()) _seek_buffer(_start_from_time);
 		if(_audio_output->state() == QAudio::SuspendedState) _audio_output->resume();
@@ -211,12 +433,34 @@ void Engine::play(qreal tempo_change, int pitch_change) {
 	}
 }
 
+void Engine::set_parameters(qreal tempo_change, int pitch_change) {
+	if(!is_ready() || (tempo_change == _curr_tempo_change && pitch_change == _curr_pitch_change)) return;
+
+	_curr_tempo_change = tempo_change;
+	_curr_pitch_change = pitch_change;
+	cancel_processing();
+
+	// the device switches to the cached rendition, if there is one, or processes the audio on the fly while waiting
+	// for the background processing to finish
+	_out_file = Rendition();
+	qint64 from_us, to_us;
+	_required_region(from_us, to_us);
+	_select_rendition(from_us, to_us);
+	_audio_output_IO_device.set_parameters(tempo_change, pitch_change);
+	_update_rendition(from_us, to_us);
+}
+
 void Engine::pause() {
 	if(is_ready() && _audio_output->state() == QAudio::ActiveState) {
 		_audio_output->suspend();
 	}
 }
 
+void Engine::cancel_processing() {
+	_renderer->cancel();
+	_is_processing = false;
+}
+
 void Engine::stop() {
 	if(is_ready()) {
 		_audio_output->stop();
@@ -226,6 +470,13 @@ void Engine::stop() {
 }
 
 void Engine::_handle_state_changed(QAudio::State newState) {
+	if(Tracer::shared().is_enabled()) {
+		static const char *state_names[] = { "active", "suspended", "stopped", "idle", "interrupted" };
+		QJsonObject args;
+		args["state"] = ((int) newState < 5) ? state_names[newState] : "unknown";
+		Tracer::shared().instant("playback", "audio_state", args);
+	}
+
 	switch(newState) {
 	case QAudio::StoppedState:
 		// Stopped for other reasons
@@ -252,29 +503,20 @@ void Engine::_handle_state_changed(QAudio::State newState) {
 }
 
 void Engine::_seek_buffer(qint64 new_time) {
-	qint64 real_time = _from_original_to_real_time(new_time);
-	_audio_output_IO_device.seek(_out_file->bytes_from_us(real_time));
-}
-
-qint64 Engine::_from_original_to_real_time(qint64 pos) {
-	qreal factor = 100./(_curr_tempo_change + 100.);
-	return pos*factor;
-}
-
-qint64 Engine::_from_real_to_original_time(qint64 pos) {
-	qreal factor = (_curr_tempo_change + 100.)/100.;
-	return pos*factor;
+	_audio_output_IO_device.seek_us(new_time);
 }
 
 void Engine::_audio_notify() {
-	qint64 elapsed_time = _from_real_to_original_time(_audio_output->processedUSecs());
-	_set_play_time(elapsed_time);
+	// the device keeps track of the tempo changes that took place while playing
+	qint64 play_time = _audio_output_IO_device.original_us_at(_audio_output->processedUSecs());
+	_set_play_time(play_time - _start_from_time);
 }
 
 void Engine::_set_play_time(qint64 elapsed_time) {
 	if(elapsed_time < 0) elapsed_time = 0;
 	qint64 new_time = _start_from_time + elapsed_time;
-	if(_end_at_time >= 0 && new_time >= _end_at_time) {
+	// when looping, the device takes care of going back to the beginning of the selection
+	if(!_looping && _end_at_time >= 0 && new_time >= _end_at_time) {
 		stop();
 		emit ended();
 	}
@@ -285,12 +527,142 @@ void Engine::_set_play_time(qint64 elapsed_time) {
 	}
 }
 
-void Engine::_process(qreal tempo_change, int pitch_change) {
-	_out_file = SoundUtils::Instance()->process(*_wav_file, tempo_change, pitch_change);
+void Engine::_process(qint64 from_us, qint64 to_us) {
+	// the current tempo and pitch changes have the precedence
+	_cancel_speculation();
+
+	_is_processing = true;
+	_processing_start_us = from_us;
+	_processing_end_us = to_us;
+	_renderer->request(_samples, _curr_tempo_change, _curr_pitch_change, from_us, to_us);
+}
+
+Rendition Engine::_processed_file(qint64 from_us, qint64 to_us) {
+	_update_rendition(from_us, to_us);
+	// the audio that is stretched on the fly must be processed anyway
+	if(!_out_file.covers(from_us, to_us) && !_is_processing) _process(from_us, to_us);
+	while(!_out_file.covers(from_us, to_us) && _is_processing) {
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+	}
+	if(!_out_file.covers(from_us, to_us)) throw std::runtime_error("Processing aborted");
+
+	return _out_file;
+}
+
+void Engine::_required_region(qint64 &from_us, qint64 &to_us) {
+	if(_render_selection_only && _has_selection) {
+		from_us = _start_from_time;
+		to_us = _end_at_time;
+	}
+	else {
+		from_us = 0;
+		to_us = _samples->duration_us();
+	}
+}
+
+bool Engine::_stretches_on_the_fly() {
+	return !_original && !(_render_selection_only && _has_selection);
+}
+
+void Engine::_update_rendition(qint64 from_us, qint64 to_us) {
+	if(!_out_file.covers(from_us, to_us)) {
+		_select_rendition(from_us, to_us);
+		if(!_out_file.is_valid()) {
+			// the background processing might be already taking care of it
+			if(_is_processing && from_us >= _processing_start_us && to_us <= _processing_end_us) return;
+			// processing the whole of a long file would take as much memory as decoding it
+			if(_stretches_on_the_fly()) return;
+
+			cancel_processing();
+			_process(from_us, to_us);
+			return;
+		}
+	}
+
+	_speculate_next();
+}
+
+void Engine::_on_rendered(Rendition result) {
+	_cache.insert(result);
+
+	// the result might refer to parameters or to a region that are not current anymore, e.g. a render for the old
+	// selection that was already queued when the selection changed
+	qint64 from_us = _processing_start_us, to_us = _processing_end_us;
+	if(!_is_processing) _required_region(from_us, to_us);
+	if(result.tempo_change == _curr_tempo_change && result.pitch_change == _curr_pitch_change && result.covers(from_us, to_us)) {
+		_out_file = result;
+		// the rendition will be used from the next seek onwards
+		_audio_output_IO_device.set_rendition(_out_file);
+		_is_processing = false;
+		emit processed();
+
+		_speculate_next();
+	}
+}
+
+void Engine::_on_speculated(Rendition result) {
+	_is_speculating = false;
+	_cache.insert(result);
+
+	qint64 from_us, to_us;
+	_required_region(from_us, to_us);
+	if(!_cache.peek(result.tempo_change, result.pitch_change).covers(from_us, to_us)) {
+		// the result could not be stored: there is no point in trying again
+		auto candidate = std::make_pair(result.tempo_change, result.pitch_change);
+		_speculative_candidates.erase(std::remove(_speculative_candidates.begin(), _speculative_candidates.end(), candidate), _speculative_candidates.end());
+	}
+	else if(result.tempo_change == _curr_tempo_change && result.pitch_change == _curr_pitch_change && !_out_file.covers(from_us, to_us)) {
+		// the user got here before the speculative processing was over
+		cancel_processing();
+		_out_file = result;
+		_audio_output_IO_device.set_rendition(_out_file);
+		emit processed();
+	}
+
+	_speculate_next();
+}
+
+void Engine::_select_rendition(qint64 from_us, qint64 to_us) {
+	Rendition candidate;
+	// the original file does not need any processing
+	if(_curr_tempo_change == 0. && _curr_pitch_change == 0 && _original) candidate = Rendition(_original, 0., 0, 0, _original->duration_us());
+	else candidate = _cache.get(_curr_tempo_change, _curr_pitch_change);
+
+	_out_file = candidate.covers(from_us, to_us) ? candidate : Rendition();
+	_audio_output_IO_device.set_rendition(_out_file);
+}
+
+void Engine::_speculate_next() {
+	// processing the current tempo and pitch changes always takes the precedence
+	if(!is_ready() || _is_processing || _is_speculating || _stretches_on_the_fly()) return;
+
+	qint64 from_us, to_us;
+	_required_region(from_us, to_us);
+
+	// speculative renditions should not evict anything from the cache
+	qint64 free_bytes = _cache.budget() - _cache.size();
+	qint64 frame_size = _samples->channels() * SoundUtils::OUTPUT_BITS_PER_SAMPLE / 8;
+	qint64 n_frames = (to_us - from_us) * _samples->sample_rate() / 1000000;
+
+	for(auto &candidate : _speculative_candidates) {
+		bool is_original = (candidate.first == 0. && candidate.second == 0);
+		bool is_current = (candidate.first == _curr_tempo_change && candidate.second == _curr_pitch_change);
+		if(is_original || is_current) continue;
+		if(_cache.peek(candidate.first, candidate.second).covers(from_us, to_us)) continue;
+
+		qint64 estimated_size = n_frames * frame_size * 100. / (candidate.first + 100.);
+		if(estimated_size > free_bytes) continue;
+
+		_is_speculating = true;
+		_speculating_candidate = candidate;
+		_speculative_renderer->request(_samples, candidate.first, candidate.second, from_us, to_us);
+		return;
+	}
+}
 
-	_audio_output_IO_device.close();
-	_audio_output_IO_device.setBuffer(_out_file->data());
-	_audio_output_IO_device.open(QIODevice::ReadOnly);
+void Engine::_cancel_speculation() {
+	_speculative_renderer->cancel();
+	_is_speculating = false;
 }
 
 } /* namespace cb */
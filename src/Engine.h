@@ -9,30 +9,114 @@
 #define SRC_ENGINE_H_
 
 #include <memory>
+#include <vector>
+#include <utility>
 
 #include <QObject>
-#include <QBuffer>
+#include <QThread>
 #include <QByteArray>
 #include <QAudioDeviceInfo>
 #include <QAudioFormat>
 #include "SoundUtils/Wave.h"
+#include "SoundUtils/SampleStore.h"
+#include "SoundUtils/StretchDevice.h"
+#include "SoundUtils/RenditionCache.h"
 
 class QAudioOutput;
 class QString;
 
 namespace cb {
 
+class Renderer;
+
 class Engine: public QObject {
 	Q_OBJECT;
 
 public:
+	/// Default duration (in microseconds) from which compressed files are decoded lazily. See set_lazy_decoding().
+	static const qint64 DEFAULT_LAZY_DECODING_US = 30 * 60 * 1000000LL;
+
 	Engine(QObject *parent);
 	virtual ~Engine();
 
+	/**
+	 * Decode an audio file. The format is inferred from the extension. This method does not require an Engine
+	 * instance, and can be called from any thread.
+	 *
+	 * @param filename
+	 * @return The decoded audio
+	 */
+	static std::shared_ptr<Wave> decode(const QString &filename);
+	/**
+	 * Decode an audio file to floats, which is what processing works with. mp3 files are decoded straight to floats,
+	 * without going through a 16-bit wave, and long ones are decoded in parallel. Like decode(), it can be called
+	 * from any thread.
+	 *
+	 * @param filename
+	 * @param n_threads Number of threads to use. Pass a non-positive number to use as many threads as there are cores
+	 * @return The decoded samples
+	 */
+	static std::shared_ptr<SampleStore> decode_samples(const QString &filename, int n_threads = 0);
+
 	void load(const QString &filename);
+	/**
+	 * Set the duration from which mp3 files are decoded lazily: rather than decoding the whole file when it is loaded,
+	 * only the portions that are played, viewed or processed are decoded, and a limited amount of them is kept in
+	 * memory. Without a selection, the audio is then stretched on the fly rather than processed in the background.
+	 * It takes effect from the next load(). Lazy decoding requires libmpg123 to be built with float output.
+	 *
+	 * @param min_duration_us Minimum duration (in microseconds). Pass a negative number to always decode whole files
+	 */
+	void set_lazy_decoding(qint64 min_duration_us);
 	void set_boundaries(qint64 start_us, qint64 end_us);
 	void set_volume(qreal new_volume);
-	const QByteArray *data();
+	/**
+	 * Set the maximum amount of memory that can be used to store processed audio for later use.
+	 *
+	 * @param bytes
+	 */
+	void set_cache_budget(qint64 bytes);
+	/**
+	 * If enabled, only the selected region (if any) is processed in the background, rather than the whole audio.
+	 *
+	 * @param enabled
+	 */
+	void set_render_selection_only(bool enabled);
+	/**
+	 * Set the tempo and pitch changes that are likely to be used next. Whenever the engine is not busy processing the
+	 * current tempo and pitch changes, these are processed in the background, at low priority and in the given
+	 * order, as long as the results fit in the cache without evicting anything.
+	 *
+	 * @param candidates List of (tempo change, pitch change) pairs
+	 */
+	void set_speculative_candidates(const std::vector<std::pair<qreal, int>> &candidates);
+	/**
+	 * Set the amount of stretched audio that is kept ready for the audio output. See StretchDevice::set_watermarks().
+	 *
+	 * @param low_us Low watermark (in microseconds)
+	 * @param high_us High watermark (in microseconds)
+	 */
+	void set_buffer_watermarks(qint64 low_us, qint64 high_us);
+	/// Number of times the audio output ran out of data since playing last started from a new position.
+	int underrun_count();
+	/**
+	 * If enabled, playing does not stop at the end of the selection but seamlessly starts over from its beginning.
+	 *
+	 * @param enabled
+	 */
+	void set_looping(bool enabled);
+	/**
+	 * Set the length of the crossfade between the end and the beginning of the loop.
+	 *
+	 * @param crossfade_us Length of the crossfade (in microseconds). Pass 0 to disable crossfading
+	 */
+	void set_loop_crossfade(qint64 crossfade_us);
+	/// The raw samples of the audio that has been loaded, or nullptr if it is being decoded lazily.
+	const char *data();
+	/// The audio that has been loaded, or nullptr if it is being decoded lazily.
+	std::shared_ptr<const Wave> wave();
+	/// The samples of the audio that has been loaded, whether it is decoded lazily or not.
+	std::shared_ptr<const SampleSource> source();
 
 	int channel_count();
 	int sample_size();
@@ -42,18 +126,37 @@ public:
 
 	bool is_playing();
 	bool is_ready();
+	bool is_processing();
 
 	void export_all(QString filename);
 	void export_selection(QString filename);
 
 public slots:
+	/**
+	 * Start or resume playing with the given tempo and pitch changes.
+	 *
+	 * @param tempo_change Change in tempo (in percentage)
+	 * @param pitch_change Change in pitch (in number of semitones)
+	 */
 	void play(qreal tempo_change, int pitch_change);
+	/**
+	 * Change tempo and pitch. If the audio is playing, it keeps playing and the new values take effect almost
+	 * immediately.
+	 *
+	 * @param tempo_change Change in tempo (in percentage)
+	 * @param pitch_change Change in pitch (in number of semitones)
+	 */
+	void set_parameters(qreal tempo_change, int pitch_change);
 	void pause();
 	void stop();
+	/// Abort the processing that is taking place in the background, if any.
+	void cancel_processing();
 
 private slots:
 	void _handle_state_changed(QAudio::State newState);
     void _audio_notify();
+    void _on_rendered(cb::Rendition result);
+    void _on_speculated(cb::Rendition result);
 
 signals:
 	 /**
@@ -67,30 +170,84 @@ signals:
 	void stopped();
 	void ended();
 
+	/**
+	 * The background processing of the audio has progressed.
+	 * \param fraction Fraction of the audio that has been processed so far
+	 */
+	void processing_progress(qreal fraction);
+	void processed();
+
 private:
-	void _load_wave(const QString &filename);
-	void _load_mp3(const QString &filename);
+	static std::shared_ptr<Wave> _load_wave(const QString &filename);
+	static std::shared_ptr<Wave> _load_mp3(const QString &filename);
+	static std::shared_ptr<SampleStore> _load_mp3_samples(const QString &filename, int n_threads);
+	static std::shared_ptr<SampleSource> _open_mp3_source(const QString &filename);
+	/// True if the given file should be decoded lazily, according to its format and duration.
+	bool _decodes_lazily(const QString &filename);
+	/// A wave holding the given samples in the output format of the renditions.
+	static std::shared_ptr<Wave> _output_wave(const SampleStore &samples);
 	void _reset();
 	void _seek_buffer(qint64 new_time);
-	qint64 _from_original_to_real_time(qint64 time);
-	qint64 _from_real_to_original_time(qint64 time);
 	void _set_play_time(qint64 time);
 
-	/** Process the audio stored in _wav_file and store it in _out_file.
+	/** Start processing a region of the audio stored in _wav_file in the background. The result will be stored in _out_file.
 	 *
-	 * The new audio will be generated according to the values passed in as parameters.
+	 * The new audio will be generated according to the current tempo and pitch changes. Playback does not strictly
+	 * need this, since the audio output device can stretch the audio on the fly, but exporting does.
 	 *
-	 * @param tempo_change Change in tempo (in percentage)
-	 * @param pitch_change Change in pitch (in number of semitones)
+	 * @param from_us Beginning of the region (in microseconds of the original stream)
+	 * @param to_us End of the region (in microseconds of the original stream)
+	 */
+	void _process(qint64 from_us, qint64 to_us);
+
+	/**
+	 * Return a rendition that covers the given region, waiting for the background processing to finish if required.
+	 * Events are processed while waiting, so that the GUI stays responsive.
+	 *
+	 * @param from_us Beginning of the region (in microseconds of the original stream)
+	 * @param to_us End of the region (in microseconds of the original stream)
+	 * @return The processed audio
+	 */
+	Rendition _processed_file(qint64 from_us, qint64 to_us);
+
+	/// Return the region that should be processed in the background, according to the current selection.
+	void _required_region(qint64 &from_us, qint64 &to_us);
+
+	/**
+	 * True if the whole audio is stretched on the fly by the device rather than processed in the background, which
+	 * is the case when a file that is decoded lazily is played without a selection.
 	 */
-	void _process(qreal tempo_change, int pitch_change);
+	bool _stretches_on_the_fly();
+
+	/// Make sure that _out_file covers the given region, starting the background processing if required.
+	void _update_rendition(qint64 from_us, qint64 to_us);
+
+	/// Use the rendition for the current tempo and pitch changes as _out_file, if there is one that covers the given region.
+	void _select_rendition(qint64 from_us, qint64 to_us);
+
+	/// Start processing the next speculative candidate, if the engine is idle and there is one worth processing.
+	void _speculate_next();
+	void _cancel_speculation();
 
 private:
 	QAudioDeviceInfo _audio_output_device;
 	QAudioOutput *_audio_output;
 	QAudioFormat _audio_format;
-    QBuffer _audio_output_IO_device;
-    std::unique_ptr<Wave> _wav_file, _out_file;
+    StretchDevice _audio_output_IO_device;
+    /// The audio that has been loaded, or nullptr if it is being decoded lazily.
+    std::shared_ptr<Wave> _wav_file;
+    /// The samples of _wav_file as floats, which is what the renderers and the device process: _wav_file itself if it
+    /// is mapped, a converted copy otherwise. When the audio is decoded lazily, this is the only copy of it.
+    std::shared_ptr<SampleSource> _samples;
+    /// What is played and exported when neither the tempo nor the pitch are changed: _wav_file itself if its samples
+    /// are in the output format of the renditions, a 16-bit copy otherwise. nullptr if the audio is decoded lazily,
+    /// or if it is mapped from a file in another format.
+    std::shared_ptr<Wave> _original;
+    /// See set_lazy_decoding().
+    qint64 _lazy_decoding_us;
+    /// The processed version of (a region of) _wav_file, or an invalid rendition if it has not been generated for the
+    /// current tempo and pitch changes
+    Rendition _out_file;
 
     /// Starting play position (in microseconds of the original stream).
     qint64 _start_from_time;
@@ -101,6 +258,25 @@ private:
     qreal _volume;
     qreal _curr_tempo_change;
     int _curr_pitch_change;
+
+    QThread _render_thread;
+    Renderer *_renderer;
+    bool _is_processing;
+    /// The region that is being processed in the background (in microseconds of the original stream).
+    qint64 _processing_start_us, _processing_end_us;
+    bool _render_selection_only;
+    /// True if the user has selected a region of the audio.
+    bool _has_selection;
+    RenditionCache _cache;
+
+    QThread _speculation_thread;
+    Renderer *_speculative_renderer;
+    bool _is_speculating;
+    std::pair<qreal, int> _speculating_candidate;
+    std::vector<std::pair<qreal, int>> _speculative_candidates;
+
+    bool _looping;
+    qint64 _loop_crossfade_us;
 };
 
 } /* namespace cb */
@@ -34,10 +34,13 @@ MainWindow::MainWindow(Engine *engine, QWidget *parent) :
 	connect(_engine, &Engine::playing, this, &MainWindow::_engine_playing);
 	connect(_engine, &Engine::paused, this, &MainWindow::_engine_paused);
 	connect(_engine, &Engine::stopped, this, &MainWindow::_engine_stopped);
-	connect(_engine, &Engine::ended, this, &MainWindow::_engine_at_end);
+	connect(_engine, &Engine::processing_progress, this, &MainWindow::_engine_processing);
+	connect(_engine, &Engine::processed, this, &MainWindow::_engine_processed);
 
 	connect(_ui->tempo_slider, &QSlider::valueChanged, this, &MainWindow::_on_slider_change);
 	connect(_ui->pitch_slider, &QSlider::valueChanged, this, &MainWindow::_on_slider_change);
+	connect(_ui->loop_button, &QPushButton::toggled, _engine, &Engine::set_looping);
+	_engine->set_looping(_ui->loop_button->isChecked());
 
 	connect(_ui->play_button, &QPushButton::toggled, this, &MainWindow::_toggle_play);
 	connect(_ui->stop_button, &QPushButton::clicked, this, &MainWindow::_stop);
@@ -61,6 +64,7 @@ void MainWindow::load_in_engine(QString filename) {
 	try {
 		_engine->load(filename);
 		_plot->load_wave(_engine);
+		_update_speculative_candidates();
 	}
 	catch(std::exception &e) {
 		_show_critical(tr("Loading failed"), QString(e.what()));
@@ -125,9 +129,8 @@ void MainWindow::_toggle_play(bool s) {
 		qreal tempo_change = (qreal) _ui->tempo_slider->value() - 100.;
 		int pitch_change = _ui->pitch_slider->value();
 
-		this->setEnabled(false);
 		_engine->play(tempo_change, pitch_change);
-		this->setEnabled(true);
+		_update_speculative_candidates();
 	}
 	else _engine->pause();
 }
@@ -159,12 +162,27 @@ void MainWindow::_engine_stopped() {
 	_ui->play_button->setText("Play");
 }
 
-void MainWindow::_engine_at_end() {
-	if(_ui->loop_button->isChecked()) _ui->play_button->click();
+void MainWindow::_engine_processing(qreal fraction) {
+	_ui->statusbar->showMessage(tr("Processing... %1%").arg((int) (fraction * 100)));
+}
+
+void MainWindow::_engine_processed() {
+	_ui->statusbar->clearMessage();
 }
 
 void MainWindow::_on_slider_change() {
-	if(_engine->is_playing()) _toggle_play(false);
+	if(_engine->is_playing()) {
+		// the new values are applied without interrupting the playback
+		qreal tempo_change = (qreal) _ui->tempo_slider->value() - 100.;
+		int pitch_change = _ui->pitch_slider->value();
+		_engine->set_parameters(tempo_change, pitch_change);
+		_update_speculative_candidates();
+	}
+	// whatever is being processed refers to the old values
+	else if(_engine->is_processing()) {
+		_engine->cancel_processing();
+		_ui->statusbar->clearMessage();
+	}
 }
 
 void MainWindow::_init_plot() {
@@ -192,6 +210,26 @@ void MainWindow::_set_controls_state(bool state) {
 	_ui->menu_export->setEnabled(state);
 }
 
+void MainWindow::_update_speculative_candidates() {
+	int tempo = _ui->tempo_slider->value();
+	int tempo_step = _ui->tempo_slider->singleStep();
+	int pitch = _ui->pitch_slider->value();
+	int pitch_step = _ui->pitch_slider->singleStep();
+
+	// the closest neighbours come first, since they are the most likely to be selected next
+	std::vector<std::pair<int, int>> offsets = { { tempo_step, 0 }, { -tempo_step, 0 }, { 0, pitch_step }, { 0, -pitch_step }, { 2 * tempo_step, 0 }, { -2 * tempo_step, 0 } };
+	std::vector<std::pair<qreal, int>> candidates;
+	for(auto &offset : offsets) {
+		int new_tempo = tempo + offset.first;
+		int new_pitch = pitch + offset.second;
+		bool tempo_ok = new_tempo >= _ui->tempo_slider->minimum() && new_tempo <= _ui->tempo_slider->maximum();
+		bool pitch_ok = new_pitch >= _ui->pitch_slider->minimum() && new_pitch <= _ui->pitch_slider->maximum();
+		if(tempo_ok && pitch_ok) candidates.push_back(std::make_pair((qreal) new_tempo - 100., new_pitch));
+	}
+
+	_engine->set_speculative_candidates(candidates);
+}
+
 void MainWindow::_show_critical(const QString &title, const QString &msg) {
 	QMessageBox::critical(this, title, msg);
 }
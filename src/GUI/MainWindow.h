@@ -49,7 +49,8 @@ private slots:
 	void _engine_playing();
 	void _engine_paused();
 	void _engine_stopped();
-	void _engine_at_end();
+	void _engine_processing(qreal fraction);
+	void _engine_processed();
 
 	void _on_slider_change();
 
@@ -63,6 +64,8 @@ private:
 	void _init_plot();
 	void _reset_controls();
 	void _set_controls_state(bool state);
+	/// Tell the engine which tempo/pitch changes are likely to be selected next, given the current slider positions.
+	void _update_speculative_candidates();
 	static QString _supported_files_filter();
 	enum export_type {
 		ALL,
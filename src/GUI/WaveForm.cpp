@@ -8,9 +8,21 @@
 #include "WaveForm.h"
 
 #include "../Engine.h"
+#include "../SoundUtils/SoundUtils.h"
+#include "../SoundUtils/SampleSource.h"
+#include "../SoundUtils/Wave.h"
+#include "../StageTimings.h"
+#include "../Tracer.h"
 
 namespace cb {
 
+namespace {
+
+/// Number of points per channel of the overview of audio that is decoded lazily.
+const qint64 OVERVIEW_POINTS = 200000;
+
+} /* namespace */
+
 WaveForm::WaveForm(QWidget *parent) :
 				QCustomPlot(parent),
 				_scrollbar(nullptr),
@@ -73,6 +85,9 @@ void WaveForm::init(QScrollBar *scrollbar) {
 	connect(_scrollbar, &QScrollBar::valueChanged, this, &WaveForm::_plot_scrollbar_changed);
 	connect(xAxis, SIGNAL(rangeChanged(QCPRange)), this, SLOT(_x_axis_changed(QCPRange)));
 
+	connect(this, &QCustomPlot::beforeReplot, []() { Tracer::shared().begin("gui", "replot"); });
+	connect(this, &QCustomPlot::afterReplot, []() { Tracer::shared().end("gui", "replot"); });
+
 	connect(this, &QCustomPlot::mouseMove, this, &WaveForm::_on_mouse_move);
 	connect(this, &QCustomPlot::mousePress, this, &WaveForm::_on_mouse_press);
 	connect(this, &QCustomPlot::mouseRelease, this, &WaveForm::_on_mouse_release);
@@ -83,45 +98,36 @@ pair_qreal WaveForm::selection_boundaries() {
 }
 
 void WaveForm::load_wave(Engine *engine) {
-	const QByteArray *buffer = engine->data();
-	qint64 length = buffer->length();
+	StageTimer timer("waveform");
 	clearGraphs();
-	int bytes = engine->sample_size() / 8;
-	long n_samples = length / bytes;
-	int n_channels = engine->channel_count();
 	qreal length_in_seconds = engine->duration();
-	long increment = n_channels;
-	long max_val = 2 << (engine->sample_size() - 2);
-	long min_val = (engine->sample_type() == QAudioFormat::UnSignedInt) ? 0 : -max_val;
-	long max_interval = max_val - min_val;
-
-	const short *samples = reinterpret_cast<const short *>(buffer->data());
+	std::shared_ptr<const Wave> wave = engine->wave();
+	std::shared_ptr<const SampleSource> source = engine->source();
+	// audio that is decoded lazily or mapped from a file is plotted as an overview, which does not go through a copy
+	// of every sample
+	bool overview = !wave || wave->is_mapped();
+	SoundUtils::WaveformData data = overview ? SoundUtils::waveform_data(*source, OVERVIEW_POINTS) : SoundUtils::waveform_data(*wave);
 
 	// add to the plot a graph for each channel
-	long n_samples_per_channel = n_samples / n_channels;
-	QVector<qreal> x_data(n_samples_per_channel);
-	QVector<qreal> y_data(n_samples_per_channel);
-	for(int channel = 0; channel < n_channels; channel++) {
-		int idx = 0;
-		for(int i = channel; i < n_samples; i += increment, idx++) {
-			x_data[idx] = idx / (qreal) engine->sample_rate();
-			// shift each plot up
-			y_data[idx] = (qreal) (samples[i] + channel * max_interval);
-		}
-
+	for(auto &y_data : data.y) {
 		QCPGraph *graph = addGraph();
 		graph->setPen(QPen(QColor("black")));
-		graph->setData(x_data, y_data, true);
+		graph->setData(data.x, y_data, true);
 	}
 
 	_scrollbar->setRange(0, length_in_seconds);
 	xAxis->setRange(0, length_in_seconds);
-	yAxis->setRange(min_val, min_val + max_interval * n_channels);
+	yAxis->setRange(data.y_min, data.y_max);
 
 	replot();
+
+	if(wave) timer.set_processed(wave->get_data_size(), wave->get_n_samples(), wave->duration_us());
+	else timer.set_processed(source->n_samples() * sizeof(float), source->n_samples(), source->duration_us());
 }
 
 void WaveForm::update_play_position(qint64 position) {
+	// only the layer of the play position is replotted, which does not emit the replot signals
+	TraceSpan span("gui", "replot_position");
 	qreal pos_in_sec = position / (qreal) 1000000.;
 	_position->point1->setCoords(pos_in_sec, -1);
 	_position->point2->setCoords(pos_in_sec, 1);
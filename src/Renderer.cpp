@@ -0,0 +1,88 @@
+/*
+ * Renderer.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "Renderer.h"
+
+#include "SoundUtils/SoundUtils.h"
+#include "StageTimings.h"
+#include "Tracer.h"
+
+#include <QMutexLocker>
+
+namespace cb {
+
+Renderer::Renderer(int n_threads, const QString &stage) :
+				QObject(nullptr),
+				_n_threads(n_threads),
+				_stage(stage) {
+	qRegisterMetaType<Rendition>();
+
+	connect(this, &Renderer::_job_requested, this, &Renderer::_process_next, Qt::QueuedConnection);
+}
+
+Renderer::~Renderer() {
+	cancel();
+}
+
+void Renderer::request(std::shared_ptr<const SampleSource> source, qreal tempo_change, int pitch_change, qint64 start_us, qint64 end_us) {
+	{
+		QMutexLocker locker(&_mutex);
+		if(_last_token) *_last_token = true;
+
+		_last_token = CancellationToken(new std::atomic<bool>(false));
+		_next_job = std::unique_ptr<RenderJob>(new RenderJob { source, tempo_change, pitch_change, start_us, end_us, _last_token });
+	}
+
+	emit _job_requested();
+}
+
+void Renderer::cancel() {
+	QMutexLocker locker(&_mutex);
+	if(_last_token) *_last_token = true;
+	_next_job.reset();
+}
+
+void Renderer::_process_next() {
+	std::unique_ptr<RenderJob> job;
+	{
+		QMutexLocker locker(&_mutex);
+		job = std::move(_next_job);
+	}
+	// the job might have been already processed or cancelled
+	if(!job || *job->cancelled) return;
+
+	int last_percentage = -1;
+	auto callback = [this, &job, &last_percentage](qreal fraction) {
+		int percentage = fraction * 100;
+		if(percentage != last_percentage) {
+			last_percentage = percentage;
+			emit progress(fraction);
+		}
+		return !*job->cancelled;
+	};
+
+	QJsonObject args;
+	args["tempo_change"] = job->tempo_change;
+	args["pitch_change"] = job->pitch_change;
+	TraceSpan span("process", _stage, args);
+	StageTimer timer(_stage);
+	std::unique_ptr<Wave> result = SoundUtils::process_parallel(*job->source, job->tempo_change, job->pitch_change, job->start_us, job->end_us, _n_threads, callback);
+	if(result && !*job->cancelled) {
+		qint64 duration_us = job->source->duration_us();
+		qint64 start_us = qBound((qint64) 0, job->start_us, duration_us);
+		qint64 end_us = (job->end_us < 0) ? duration_us : qBound(start_us, job->end_us, duration_us);
+		// what counts is the amount of source audio that has been processed
+		int rate = job->source->sample_rate();
+		qint64 n_samples = (end_us * rate / 1000000 - start_us * rate / 1000000) * job->source->channels();
+		timer.set_processed(n_samples * sizeof(float), n_samples, end_us - start_us);
+
+		emit rendered(Rendition(std::shared_ptr<Wave>(std::move(result)), job->tempo_change, job->pitch_change, start_us, end_us));
+	}
+	else timer.discard();
+}
+
+} /* namespace cb */
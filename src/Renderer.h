@@ -0,0 +1,94 @@
+/*
+ * Renderer.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_RENDERER_H_
+#define SRC_RENDERER_H_
+
+#include <memory>
+#include <atomic>
+
+#include <QObject>
+#include <QMutex>
+#include <QMetaType>
+
+#include "SoundUtils/Wave.h"
+#include "SoundUtils/SampleSource.h"
+#include "SoundUtils/Rendition.h"
+
+namespace cb {
+
+/// A token shared between whoever requests a render and the thread that performs it.
+using CancellationToken = std::shared_ptr<std::atomic<bool>>;
+
+/**
+ * Renders tempo/pitch-changed versions of a wave. It is meant to live in its own thread: requests can be made
+ * from any thread, while the actual processing takes place in the thread the object belongs to.
+ *
+ * Only the most recent request is honoured: a new request cancels the one that is being processed (if any) and
+ * replaces those that are still waiting to be processed.
+ */
+class Renderer: public QObject {
+	Q_OBJECT;
+
+public:
+	/**
+	 * @param n_threads Number of threads used to process each request. Pass a non-positive number to use as many threads as there are cores
+	 * @param stage Name under which the processing times are recorded in StageTimings::shared()
+	 */
+	Renderer(int n_threads = 0, const QString &stage = "process");
+	virtual ~Renderer();
+
+	/**
+	 * Schedule the processing of (a region of) the given source. This method is thread-safe.
+	 *
+	 * @param source
+	 * @param tempo_change Change in tempo (in percentage)
+	 * @param pitch_change Change in pitch (in number of semitones)
+	 * @param start_us Beginning of the region (in microseconds)
+	 * @param end_us End of the region (in microseconds). Pass a negative value to process up to the end of the source
+	 */
+	void request(std::shared_ptr<const SampleSource> source, qreal tempo_change, int pitch_change, qint64 start_us = 0, qint64 end_us = -1);
+
+	/**
+	 * Abort the render that is currently being processed and drop the pending one, if any. This method is thread-safe.
+	 */
+	void cancel();
+
+signals:
+	/**
+	 * Emitted periodically while rendering.
+	 * \param fraction Fraction of the source that has been processed so far
+	 */
+	void progress(qreal fraction);
+	void rendered(cb::Rendition result);
+	void _job_requested();
+
+private slots:
+	void _process_next();
+
+private:
+	struct RenderJob {
+		std::shared_ptr<const SampleSource> source;
+		qreal tempo_change;
+		int pitch_change;
+		qint64 start_us;
+		qint64 end_us;
+		CancellationToken cancelled;
+	};
+
+	int _n_threads;
+	QString _stage;
+	QMutex _mutex;
+	/// The job that will be processed next, if any.
+	std::unique_ptr<RenderJob> _next_job;
+	/// The token of the most recently requested job.
+	CancellationToken _last_token;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_RENDERER_H_ */
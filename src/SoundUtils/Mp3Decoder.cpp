@@ -0,0 +1,193 @@
+/*
+ * Mp3Decoder.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "Mp3Decoder.h"
+
+#include "Mp3Stream.h"
+#include "SampleStore.h"
+#include "Wave.h"
+#include "../Tracer.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+namespace cb {
+
+namespace {
+
+/**
+ * Decode the whole stream straight into the given vector. The vector is sized up front according to the length of
+ * the stream, and grown only if the length turns out to be underestimated, which happens with streams that do not
+ * declare it in a Xing/Info header.
+ *
+ * @param stream
+ * @param samples
+ */
+void decode_all(Mp3Stream &stream, std::vector<float> &samples) {
+	size_t block = std::max(stream.block_size() / (qint64) sizeof(float), (qint64) 1);
+	qint64 length = stream.length();
+	samples.resize((length > 0 ? length * stream.channels() : 0) + block);
+
+	size_t n_decoded = 0;
+	while(true) {
+		if(samples.size() - n_decoded < block) samples.resize(samples.size() + std::max(block, samples.size() / 4));
+
+		size_t to_decode = samples.size() - n_decoded;
+		size_t done = stream.read(reinterpret_cast<char *>(samples.data() + n_decoded), to_decode * sizeof(float)) / sizeof(float);
+		n_decoded += done;
+		if(done < to_decode) break;
+	}
+	samples.resize(n_decoded);
+
+	// files with a damaged tail are kept as far as they can be decoded
+	if(n_decoded == 0) throw std::runtime_error(stream.at_end() ? "No audio" : stream.error().toStdString());
+}
+
+/// Decodes a range of samples for Mp3Decoder::decode().
+class RangeJob: public QRunnable {
+public:
+	RangeJob(const QString &filename, const Mp3Stream::Index &index, qint64 first_frame, qint64 last_frame, int channels, float *out, std::atomic<bool> &failed) :
+					_filename(filename),
+					_index(index),
+					_first_frame(first_frame),
+					_last_frame(last_frame),
+					_channels(channels),
+					_out(out),
+					_failed(failed) {
+		setAutoDelete(true);
+	}
+
+	virtual void run() {
+		if(_failed) return;
+
+		QJsonObject args;
+		args["first_frame"] = _first_frame;
+		args["last_frame"] = _last_frame;
+		TraceSpan span("io", "decode_range", args);
+
+		try {
+			Mp3Stream stream(_filename, Mp3Stream::FLOAT32);
+			// with the index of the whole file, seeking does not have to read all the frames that come before
+			stream.set_index(_index);
+			if(stream.channels() != _channels || !stream.seek(_first_frame)) {
+				_failed = true;
+				return;
+			}
+
+			qint64 to_decode = (_last_frame - _first_frame) * _channels * sizeof(float);
+			qint64 block = std::max(stream.block_size(), (qint64) sizeof(float));
+			char *out = reinterpret_cast<char *>(_out);
+			while(to_decode > 0 && !_failed) {
+				qint64 done = stream.read(out, std::min(block, to_decode));
+				out += done;
+				to_decode -= done;
+				if(done == 0) break;
+			}
+			// the last range may be shorter than declared if the file is damaged, and what is missing stays silent
+			if(to_decode > 0 && !stream.at_end()) _failed = true;
+		}
+		catch(std::exception &) {
+			_failed = true;
+		}
+	}
+
+private:
+	QString _filename;
+	Mp3Stream::Index _index;
+	/// The range, in frames of the decoded output (i.e. samples per channel).
+	qint64 _first_frame, _last_frame;
+	int _channels;
+	float *_out;
+	std::atomic<bool> &_failed;
+};
+
+/**
+ * Decode the whole stream in parallel, with a decoder per range. The stream is scanned first, which gives its
+ * exact length and the offsets of its frames.
+ *
+ * @return false if the stream is too short to be worth splitting, or if a range could not be decoded
+ */
+bool decode_parallel(const QString &filename, Mp3Stream &stream, int n_threads, std::vector<float> &samples) {
+	if(!stream.scan()) return false;
+
+	qint64 length = stream.length();
+	qint64 samples_per_frame = stream.samples_per_frame();
+	Mp3Stream::Index index = stream.index();
+	if(length <= 0 || samples_per_frame <= 0 || index.offsets.empty() || index.step <= 0) return false;
+
+	// the ranges start at indexed mp3 frames, so that each decoder starts right at the beginning of a frame
+	qint64 n_mp3_frames = (length + samples_per_frame - 1) / samples_per_frame;
+	qint64 n_ranges = std::min((qint64) n_threads * 2, n_mp3_frames / Mp3Decoder::MIN_SEGMENT_FRAMES);
+	if(n_ranges < 2) return false;
+	qint64 mp3_frames_per_range = (n_mp3_frames + n_ranges - 1) / n_ranges;
+	mp3_frames_per_range = ((mp3_frames_per_range + index.step - 1) / index.step) * index.step;
+
+	// the decoded output begins after the encoder and decoder delays, which are trimmed in gapless mode
+	qint64 skipped = stream.leading_delay();
+
+	int channels = stream.channels();
+	samples.assign(length * channels, 0.f);
+	std::atomic<bool> failed(false);
+	QThreadPool pool;
+	pool.setMaxThreadCount(n_threads);
+	qint64 first_frame = 0;
+	for(qint64 mp3_frame = mp3_frames_per_range; first_frame < length; mp3_frame += mp3_frames_per_range) {
+		qint64 last_frame = std::min(length, std::max(first_frame, mp3_frame * samples_per_frame - skipped));
+		if(last_frame == first_frame) continue;
+		pool.start(new RangeJob(filename, index, first_frame, last_frame, channels, samples.data() + first_frame * channels, failed));
+		first_frame = last_frame;
+	}
+	pool.waitForDone();
+
+	return !failed;
+}
+
+} /* namespace */
+
+std::shared_ptr<SampleStore> Mp3Decoder::decode(const QString &filename, int n_threads) throw (std::exception) {
+	if(!supports_float()) return std::make_shared<SampleStore>(*decode_wave(filename));
+	if(n_threads <= 0) n_threads = QThread::idealThreadCount();
+
+	Mp3Stream stream(filename, Mp3Stream::FLOAT32);
+	std::vector<float> samples;
+	// short files, and files that cannot be scanned, are decoded sequentially. Scanning does not move the stream,
+	// hence it can still be used
+	if(n_threads < 2 || !decode_parallel(filename, stream, n_threads, samples)) decode_all(stream, samples);
+
+	return std::make_shared<SampleStore>(stream.channels(), stream.sample_rate(), std::move(samples));
+}
+
+std::shared_ptr<Wave> Mp3Decoder::decode_wave(const QString &filename) throw (std::exception) {
+	Mp3Stream stream(filename, Mp3Stream::INT16);
+
+	std::shared_ptr<Wave> wave = std::make_shared<Wave>(stream.channels(), stream.sample_rate(), 16);
+	qint64 length = stream.length();
+	if(length > 0) wave->reserve_samples(length * stream.channels());
+
+	// the wave owns its buffer, hence the samples go through a block that is reused
+	std::vector<char> block(std::max(stream.block_size(), (qint64) 1));
+	qint64 done;
+	do {
+		done = stream.read(block.data(), block.size());
+		wave->append_samples(block.data(), done);
+	} while(done == (qint64) block.size());
+
+	if(wave->get_data_size() == 0) throw std::runtime_error(stream.at_end() ? "No audio" : stream.error().toStdString());
+	return wave;
+}
+
+bool Mp3Decoder::supports_float() {
+	return Mp3Stream::supports_float();
+}
+
+} /* namespace cb */
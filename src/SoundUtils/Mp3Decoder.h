@@ -0,0 +1,61 @@
+/*
+ * Mp3Decoder.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_MP3DECODER_H_
+#define SRC_SOUNDUTILS_MP3DECODER_H_
+
+#include <QString>
+
+#include <memory>
+#include <exception>
+
+namespace cb {
+
+class SampleStore;
+class Wave;
+
+/**
+ * Decoding of mp3 files through libmpg123. The library is initialised the first time it is needed and released when
+ * the program exits, and all the methods can be called from any thread.
+ */
+class Mp3Decoder {
+public:
+	/**
+	 * Decode a whole mp3 file to floats. The samples are decoded straight into the store, which is sized up front
+	 * according to the length of the stream. If libmpg123 cannot output floats, 16-bit samples are decoded and
+	 * converted.
+	 *
+	 * Long files are split into ranges that start at frame boundaries, which are decoded at the same time by
+	 * independent decoders. Each decoder seeks to the first sample of its range through the frame index of the whole
+	 * file, and libmpg123 primes it by decoding the preceding frames and trims the encoder delay and padding, so that
+	 * the ranges join sample by sample.
+	 *
+	 * @param filename
+	 * @param n_threads Number of threads to use. Pass a non-positive number to use as many threads as there are cores
+	 * @return The decoded samples
+	 */
+	static std::shared_ptr<SampleStore> decode(const QString &filename, int n_threads = 0) throw (std::exception);
+	/**
+	 * Decode a whole mp3 file to a 16-bit wave.
+	 *
+	 * @param filename
+	 * @return The decoded audio
+	 */
+	static std::shared_ptr<Wave> decode_wave(const QString &filename) throw (std::exception);
+	/// True if libmpg123 has been built with float output.
+	static bool supports_float();
+
+	/// Minimum number of mp3 frames (about 26 ms each at 44.1 kHz) in the ranges decoded in parallel by decode().
+	static const int MIN_SEGMENT_FRAMES = 384;
+
+private:
+	Mp3Decoder() = delete;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_MP3DECODER_H_ */
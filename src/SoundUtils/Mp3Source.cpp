@@ -0,0 +1,189 @@
+/*
+ * Mp3Source.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "Mp3Source.h"
+
+#include "../Tracer.h"
+
+#include <QMutexLocker>
+#include <QDebug>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace cb {
+
+namespace {
+
+/// Maximum number of idle streams kept open, which is about the number of threads that read at the same time.
+const size_t MAX_IDLE_STREAMS = 4;
+
+} /* namespace */
+
+// std::min() takes it by reference, hence it needs a definition
+const qint64 Mp3Source::BLOCK_FRAMES;
+
+Mp3Source::Mp3Source(const QString &filename, qint64 cache_budget) throw (std::exception) :
+				_filename(filename),
+				_channels(0),
+				_sample_rate(0),
+				_length(0),
+				_budget(cache_budget),
+				_size(0) {
+	std::unique_ptr<Mp3Stream> stream(new Mp3Stream(filename, Mp3Stream::FLOAT32));
+	if(!stream->scan() || stream->length() <= 0) {
+		throw std::runtime_error(QString("Cannot index '%1': %2").arg(filename).arg(stream->error()).toStdString());
+	}
+
+	_channels = stream->channels();
+	_sample_rate = stream->sample_rate();
+	_length = stream->length();
+	_index = stream->index();
+
+	// scanning does not move the stream, which is ready to decode the first block
+	_idle_streams.push_back(std::move(stream));
+}
+
+Mp3Source::~Mp3Source() {
+
+}
+
+int Mp3Source::channels() const {
+	return _channels;
+}
+
+int Mp3Source::sample_rate() const {
+	return _sample_rate;
+}
+
+qint64 Mp3Source::n_samples() const {
+	return _length * _channels;
+}
+
+qint64 Mp3Source::read(qint64 offset, qint64 n_samples, float *dest) const {
+	if(offset < 0 || offset >= this->n_samples()) return 0;
+
+	n_samples = std::min(n_samples, this->n_samples() - offset);
+	const qint64 block_samples = BLOCK_FRAMES * _channels;
+	qint64 n_read = 0;
+	while(n_read < n_samples) {
+		qint64 position = offset + n_read;
+		qint64 index = position / block_samples;
+		qint64 first = position - index * block_samples;
+
+		Block block = _block(index);
+		qint64 n_copied = std::min(n_samples - n_read, (qint64) block->size() - first);
+		std::copy(block->begin() + first, block->begin() + first + n_copied, dest + n_read);
+		n_read += n_copied;
+	}
+
+	return n_read;
+}
+
+void Mp3Source::set_cache_budget(qint64 budget) {
+	QMutexLocker locker(&_mutex);
+	_budget = budget;
+	_evict(0);
+}
+
+qint64 Mp3Source::cache_budget() const {
+	QMutexLocker locker(&_mutex);
+	return _budget;
+}
+
+qint64 Mp3Source::cache_size() const {
+	QMutexLocker locker(&_mutex);
+	return _size;
+}
+
+Mp3Source::Block Mp3Source::_block(qint64 index) const {
+	{
+		QMutexLocker locker(&_mutex);
+		auto it = _cached.find(index);
+		if(it != _cached.end()) {
+			// move the entry to the front of the list
+			_entries.splice(_entries.begin(), _entries, it->second);
+			return it->second->block;
+		}
+	}
+
+	// two threads might decode the same block at the same time, in which case the first one to finish wins
+	Block block = _decode(index);
+	qint64 block_size = block->size() * sizeof(float);
+
+	QMutexLocker locker(&_mutex);
+	auto it = _cached.find(index);
+	if(it != _cached.end()) return it->second->block;
+
+	// the block is stored even if it is larger than the whole budget, since the caller holds it anyway
+	_evict(block_size);
+	_entries.push_front(Entry { index, block });
+	_cached[index] = _entries.begin();
+	_size += block_size;
+
+	return block;
+}
+
+Mp3Source::Block Mp3Source::_decode(qint64 index) const {
+	qint64 first_frame = index * BLOCK_FRAMES;
+	qint64 n_frames = std::min(BLOCK_FRAMES, _length - first_frame);
+
+	QJsonObject args;
+	args["block"] = index;
+	TraceSpan span("io", "decode_block", args);
+
+	// what cannot be decoded stays silent
+	std::shared_ptr<std::vector<float>> block = std::make_shared<std::vector<float>>(n_frames * _channels, 0.f);
+	try {
+		std::unique_ptr<Mp3Stream> stream = _take_stream(first_frame);
+		if(stream->position() == first_frame || stream->seek(first_frame)) {
+			stream->read(reinterpret_cast<char *>(block->data()), block->size() * sizeof(float));
+
+			QMutexLocker locker(&_mutex);
+			if(_idle_streams.size() < MAX_IDLE_STREAMS) _idle_streams.push_back(std::move(stream));
+		}
+	}
+	catch(std::exception &e) {
+		qWarning() << "Cannot decode block" << index << "of" << _filename << ":" << e.what();
+	}
+
+	return block;
+}
+
+std::unique_ptr<Mp3Stream> Mp3Source::_take_stream(qint64 frame) const {
+	{
+		QMutexLocker locker(&_mutex);
+		if(!_idle_streams.empty()) {
+			auto it = std::find_if(_idle_streams.begin(), _idle_streams.end(), [frame](const std::unique_ptr<Mp3Stream> &stream) {
+				return stream->position() == frame;
+			});
+			if(it == _idle_streams.end()) it = _idle_streams.begin();
+
+			std::unique_ptr<Mp3Stream> stream = std::move(*it);
+			_idle_streams.erase(it);
+			return stream;
+		}
+	}
+
+	// with the index of the whole file, seeking does not have to read all the frames that come before
+	std::unique_ptr<Mp3Stream> stream(new Mp3Stream(_filename, Mp3Stream::FLOAT32));
+	stream->set_index(_index);
+	if(stream->channels() != _channels) throw std::runtime_error("The format of the file has changed");
+
+	return stream;
+}
+
+void Mp3Source::_evict(qint64 required) const {
+	while(!_entries.empty() && _size + required > _budget) {
+		Entry &last = _entries.back();
+		_size -= last.block->size() * sizeof(float);
+		_cached.erase(last.index);
+		_entries.pop_back();
+	}
+}
+
+} /* namespace cb */
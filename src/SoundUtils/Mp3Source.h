@@ -0,0 +1,99 @@
+/*
+ * Mp3Source.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_MP3SOURCE_H_
+#define SRC_SOUNDUTILS_MP3SOURCE_H_
+
+#include <QString>
+#include <QMutex>
+
+#include <memory>
+#include <list>
+#include <map>
+#include <vector>
+#include <exception>
+
+#include "SampleSource.h"
+#include "Mp3Stream.h"
+
+namespace cb {
+
+/**
+ * An mp3 file that is decoded lazily, block by block, as its samples are read. The file is scanned when the source is
+ * created, which gives its exact length and an index of its frames, so that any block can be decoded without
+ * decoding the ones that come before.
+ *
+ * Decoded blocks are kept in a least-recently-used cache that holds at most cache_budget() bytes of samples, hence
+ * the memory used depends on the portions of the file that are being played, viewed or processed rather than on its
+ * length. Reads from several threads decode different blocks at the same time, each with its own stream.
+ */
+class Mp3Source: public SampleSource {
+public:
+	/// Default memory budget (in bytes) of the decoded blocks.
+	static const qint64 DEFAULT_CACHE_BUDGET = 64 * 1024 * 1024;
+	/// Number of frames (samples per channel) decoded at once.
+	static const qint64 BLOCK_FRAMES = 65536;
+
+	/**
+	 * Open and scan a file. Nothing is decoded until samples are read.
+	 *
+	 * @param filename
+	 * @param cache_budget Maximum number of bytes held by the decoded blocks
+	 */
+	Mp3Source(const QString &filename, qint64 cache_budget = DEFAULT_CACHE_BUDGET) throw (std::exception);
+	virtual ~Mp3Source();
+
+	Mp3Source(const Mp3Source &) = delete;
+	Mp3Source &operator=(const Mp3Source &) = delete;
+
+	virtual int channels() const;
+	virtual int sample_rate() const;
+	virtual qint64 n_samples() const;
+	/// Samples that cannot be decoded, for example in a damaged portion of the file, are read as silence.
+	virtual qint64 read(qint64 offset, qint64 n_samples, float *dest) const;
+
+	void set_cache_budget(qint64 budget);
+	qint64 cache_budget() const;
+	/// Number of bytes currently held by the decoded blocks.
+	qint64 cache_size() const;
+
+private:
+	typedef std::shared_ptr<const std::vector<float>> Block;
+	struct Entry {
+		qint64 index;
+		Block block;
+	};
+
+	/// Return a block, decoding it if it is not in the cache.
+	Block _block(qint64 index) const;
+	Block _decode(qint64 index) const;
+	/// Take an idle stream, preferably one that is already at the given frame, or open a new one.
+	std::unique_ptr<Mp3Stream> _take_stream(qint64 frame) const;
+	void _evict(qint64 required) const;
+
+	QString _filename;
+	int _channels;
+	int _sample_rate;
+	/// Number of frames (samples per channel).
+	qint64 _length;
+	Mp3Stream::Index _index;
+
+	/// Guards the cache and the idle streams. Blocks are decoded without holding it.
+	mutable QMutex _mutex;
+	mutable qint64 _budget;
+	mutable qint64 _size;
+	/// The decoded blocks, sorted from the most to the least recently used.
+	mutable std::list<Entry> _entries;
+	mutable std::map<qint64, std::list<Entry>::iterator> _cached;
+	/// Streams that are not decoding, kept open since playback reads the blocks in order and can go on from where
+	/// the previous block ended.
+	mutable std::vector<std::unique_ptr<Mp3Stream>> _idle_streams;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_MP3SOURCE_H_ */
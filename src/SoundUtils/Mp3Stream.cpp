@@ -0,0 +1,257 @@
+/*
+ * Mp3Stream.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "Mp3Stream.h"
+
+#include <QFile>
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#ifndef NOMP3
+#include <mpg123.h>
+#endif
+
+namespace cb {
+
+#ifndef NOMP3
+
+namespace {
+
+/// mpg123_init() must be called before anything else, and it is not thread-safe.
+void init_library() {
+	struct Library {
+		Library() {
+			mpg123_init();
+		}
+
+		~Library() {
+			mpg123_exit();
+		}
+	};
+	// function-local statics are initialised exactly once, even when several threads get here at the same time
+	static Library library;
+	Q_UNUSED(library);
+}
+
+} /* namespace */
+
+Mp3Stream::Mp3Stream(const QString &filename, Encoding encoding) throw (std::exception) :
+				_handle(nullptr),
+				_encoding(encoding == FLOAT32 ? MPG123_ENC_FLOAT_32 : MPG123_ENC_SIGNED_16),
+				_sample_rate(0),
+				_channels(0),
+				_last_result(MPG123_OK) {
+	init_library();
+
+	int error;
+	_handle = mpg123_new(nullptr, &error);
+	if(_handle == nullptr) throw std::runtime_error(mpg123_plain_strerror(error));
+	// gapless decoding trims the encoder delay and padding declared by the LAME/Info header
+	mpg123_param(_handle, MPG123_ADD_FLAGS, MPG123_QUIET | MPG123_GAPLESS, 0.);
+
+	// any rate and any number of channels, but only the given encoding
+	mpg123_format_none(_handle);
+	const long *rates;
+	size_t n_rates;
+	mpg123_rates(&rates, &n_rates);
+	for(size_t i = 0; i < n_rates; i++) {
+		mpg123_format(_handle, rates[i], MPG123_MONO | MPG123_STEREO, _encoding);
+	}
+
+	int file_encoding;
+	if(mpg123_open(_handle, QFile::encodeName(filename).constData()) != MPG123_OK || mpg123_getformat(_handle, &_sample_rate, &_channels, &file_encoding) != MPG123_OK) {
+		std::string message = mpg123_strerror(_handle);
+		mpg123_delete(_handle);
+		throw std::runtime_error(message);
+	}
+	// the format must not change while decoding
+	mpg123_format_none(_handle);
+	mpg123_format(_handle, _sample_rate, _channels, _encoding);
+}
+
+Mp3Stream::~Mp3Stream() {
+	mpg123_close(_handle);
+	mpg123_delete(_handle);
+}
+
+int Mp3Stream::channels() const {
+	return _channels;
+}
+
+int Mp3Stream::sample_rate() const {
+	return _sample_rate;
+}
+
+int Mp3Stream::bytes_per_sample() const {
+	return (_encoding == MPG123_ENC_FLOAT_32) ? sizeof(float) : sizeof(int16_t);
+}
+
+qint64 Mp3Stream::length() const {
+	// mpg123_length() returns MPG123_ERR if the length cannot be known
+	off_t length = mpg123_length(_handle);
+	return (length > 0) ? length : -1;
+}
+
+int Mp3Stream::samples_per_frame() const {
+	return mpg123_spf(_handle);
+}
+
+qint64 Mp3Stream::leading_delay() const {
+	long encoder_delay = -1, decoder_delay = -1;
+	mpg123_getstate(_handle, MPG123_ENC_DELAY, &encoder_delay, nullptr);
+	mpg123_getstate(_handle, MPG123_DEC_DELAY, &decoder_delay, nullptr);
+	return (encoder_delay >= 0 && decoder_delay >= 0) ? encoder_delay + decoder_delay : 0;
+}
+
+qint64 Mp3Stream::position() const {
+	return mpg123_tell(_handle);
+}
+
+bool Mp3Stream::at_end() const {
+	return _last_result == MPG123_DONE;
+}
+
+qint64 Mp3Stream::block_size() const {
+	return mpg123_outblock(_handle);
+}
+
+QString Mp3Stream::error() const {
+	return QString(mpg123_strerror(_handle));
+}
+
+bool Mp3Stream::scan() {
+	return mpg123_scan(_handle) == MPG123_OK;
+}
+
+Mp3Stream::Index Mp3Stream::index() const {
+	off_t *offsets = nullptr;
+	off_t step = 0;
+	size_t fill = 0;
+	Index index;
+	index.step = 0;
+	if(mpg123_index(_handle, &offsets, &step, &fill) != MPG123_OK || offsets == nullptr) return index;
+
+	index.offsets.assign(offsets, offsets + fill);
+	index.step = step;
+	return index;
+}
+
+void Mp3Stream::set_index(const Index &index) {
+	// an empty index, of a stream that could not be indexed, is of no help
+	if(index.offsets.empty() || index.step <= 0) return;
+
+	// libmpg123 copies the offsets
+	std::vector<off_t> offsets(index.offsets.begin(), index.offsets.end());
+	mpg123_set_index(_handle, offsets.data(), index.step, offsets.size());
+}
+
+bool Mp3Stream::seek(qint64 frame) {
+	_last_result = MPG123_OK;
+	return mpg123_seek(_handle, frame, SEEK_SET) == frame;
+}
+
+qint64 Mp3Stream::read(char *out, qint64 max_bytes) {
+	qint64 n_read = 0;
+	while(n_read < max_bytes && (_last_result == MPG123_OK || _last_result == MPG123_NEW_FORMAT)) {
+		size_t done = 0;
+		_last_result = mpg123_read(_handle, reinterpret_cast<unsigned char *>(out + n_read), max_bytes - n_read, &done);
+		n_read += done;
+	}
+	return n_read;
+}
+
+bool Mp3Stream::supports_float() {
+	init_library();
+
+	const int *encodings;
+	size_t n_encodings;
+	mpg123_encodings(&encodings, &n_encodings);
+	return std::find(encodings, encodings + n_encodings, (int) MPG123_ENC_FLOAT_32) != encodings + n_encodings;
+}
+
+#else
+
+Mp3Stream::Mp3Stream(const QString &filename, Encoding encoding) throw (std::exception) {
+	Q_UNUSED(encoding);
+	throw std::runtime_error(("Cannot decode '" + filename.toStdString() + "': mp3 support has not been compiled in").c_str());
+}
+
+Mp3Stream::~Mp3Stream() {
+}
+
+int Mp3Stream::channels() const {
+	return 0;
+}
+
+int Mp3Stream::sample_rate() const {
+	return 0;
+}
+
+int Mp3Stream::bytes_per_sample() const {
+	return 0;
+}
+
+qint64 Mp3Stream::length() const {
+	return -1;
+}
+
+int Mp3Stream::samples_per_frame() const {
+	return 0;
+}
+
+qint64 Mp3Stream::leading_delay() const {
+	return 0;
+}
+
+qint64 Mp3Stream::position() const {
+	return 0;
+}
+
+bool Mp3Stream::at_end() const {
+	return true;
+}
+
+qint64 Mp3Stream::block_size() const {
+	return 0;
+}
+
+QString Mp3Stream::error() const {
+	return QString();
+}
+
+bool Mp3Stream::scan() {
+	return false;
+}
+
+Mp3Stream::Index Mp3Stream::index() const {
+	return Index();
+}
+
+void Mp3Stream::set_index(const Index &index) {
+	Q_UNUSED(index);
+}
+
+bool Mp3Stream::seek(qint64 frame) {
+	Q_UNUSED(frame);
+	return false;
+}
+
+qint64 Mp3Stream::read(char *out, qint64 max_bytes) {
+	Q_UNUSED(out);
+	Q_UNUSED(max_bytes);
+	return 0;
+}
+
+bool Mp3Stream::supports_float() {
+	return false;
+}
+
+#endif
+
+} /* namespace cb */
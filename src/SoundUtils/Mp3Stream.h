@@ -0,0 +1,115 @@
+/*
+ * Mp3Stream.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_MP3STREAM_H_
+#define SRC_SOUNDUTILS_MP3STREAM_H_
+
+#include <QString>
+
+#include <vector>
+#include <exception>
+
+struct mpg123_handle_struct;
+
+namespace cb {
+
+/**
+ * An mp3 file opened by its own libmpg123 decoder, in gapless mode: the encoder delay and padding declared by the
+ * LAME/Info header are trimmed, and positions refer to the trimmed output. The library is initialised the first
+ * time a stream is opened and released when the program exits.
+ *
+ * Different streams can be used by different threads at the same time, but a stream must be used by a thread at a
+ * time.
+ */
+class Mp3Stream {
+public:
+	enum Encoding {
+		INT16,
+		FLOAT32
+	};
+
+	/// Byte offsets of every step-th mp3 frame of a file, which make seeking fast.
+	struct Index {
+		std::vector<qint64> offsets;
+		qint64 step;
+	};
+
+	/**
+	 * Open a file. The samples are decoded at the rate and with the channels of the file.
+	 *
+	 * @param filename
+	 * @param encoding
+	 */
+	Mp3Stream(const QString &filename, Encoding encoding) throw (std::exception);
+	virtual ~Mp3Stream();
+
+	Mp3Stream(const Mp3Stream &) = delete;
+	Mp3Stream &operator=(const Mp3Stream &) = delete;
+
+	int channels() const;
+	int sample_rate() const;
+	/// Size (in bytes) of a sample.
+	int bytes_per_sample() const;
+	/// Number of frames (samples per channel) of the decoded output: exact after scan(), estimated before. -1 if unknown.
+	qint64 length() const;
+	/// Number of frames (samples per channel) decoded from each mp3 frame.
+	int samples_per_frame() const;
+	/// Number of frames trimmed from the beginning of the output, i.e. the encoder and decoder delays. 0 if unknown.
+	qint64 leading_delay() const;
+	/// Position (in frames of the decoded output) of the next frame that read() returns.
+	qint64 position() const;
+	/// True if the whole stream has been decoded.
+	bool at_end() const;
+	/// Suggested size (in bytes) of the buffers passed to read().
+	qint64 block_size() const;
+	/// Description of the last error.
+	QString error() const;
+
+	/**
+	 * Parse all the mp3 frames without decoding them, which gives the exact length and fills the index. The position
+	 * does not change.
+	 *
+	 * @return false if the file could not be parsed
+	 */
+	bool scan();
+	/// The offsets of the mp3 frames, which are complete after scan(). The index is empty if it cannot be retrieved.
+	Index index() const;
+	/// Use the index of another stream of the same file, which saves scanning the frames that come before a seek.
+	void set_index(const Index &index);
+	/**
+	 * Move to the given frame of the decoded output. libmpg123 decodes some mp3 frames before it, so that the output
+	 * is the same as if the stream had been decoded from the beginning.
+	 *
+	 * @param frame
+	 * @return false if the frame could not be reached
+	 */
+	bool seek(qint64 frame);
+	/**
+	 * Decode the next samples.
+	 *
+	 * @param out Buffer with room for at least max_bytes bytes
+	 * @param max_bytes
+	 * @return The number of bytes decoded, which is smaller than max_bytes only at the end of the stream or if an
+	 * error occurs
+	 */
+	qint64 read(char *out, qint64 max_bytes);
+
+	/// True if libmpg123 has been built with float output.
+	static bool supports_float();
+
+private:
+	mpg123_handle_struct *_handle;
+	int _encoding;
+	long _sample_rate;
+	int _channels;
+	/// Result of the last call to mpg123_read().
+	int _last_result;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_MP3STREAM_H_ */
@@ -0,0 +1,113 @@
+/*
+ * ProcessorPool.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "ProcessorPool.h"
+
+#include <QMutexLocker>
+#include <QThread>
+
+namespace cb {
+
+ProcessorPool::Lease::Lease() :
+				_pool(nullptr) {
+
+}
+
+ProcessorPool::Lease::Lease(ProcessorPool *pool, std::unique_ptr<soundtouch::SoundTouch> processor) :
+				_pool(pool),
+				_processor(std::move(processor)) {
+
+}
+
+ProcessorPool::Lease::Lease(Lease &&other) :
+				_pool(other._pool),
+				_processor(std::move(other._processor)) {
+	other._pool = nullptr;
+}
+
+ProcessorPool::Lease &ProcessorPool::Lease::operator=(Lease &&other) {
+	if(this != &other) {
+		_release();
+		_pool = other._pool;
+		_processor = std::move(other._processor);
+		other._pool = nullptr;
+	}
+	return *this;
+}
+
+ProcessorPool::Lease::~Lease() {
+	_release();
+}
+
+bool ProcessorPool::Lease::is_valid() const {
+	return _processor != nullptr;
+}
+
+soundtouch::SoundTouch *ProcessorPool::Lease::operator->() const {
+	return _processor.get();
+}
+
+soundtouch::SoundTouch &ProcessorPool::Lease::operator*() const {
+	return *_processor;
+}
+
+void ProcessorPool::Lease::_release() {
+	if(_pool != nullptr && _processor) _pool->_give_back(std::move(_processor));
+	_pool = nullptr;
+}
+
+ProcessorPool &ProcessorPool::shared() {
+	// the initialisation of function-local statics is thread-safe
+	static ProcessorPool pool(2 * QThread::idealThreadCount());
+	return pool;
+}
+
+ProcessorPool::ProcessorPool(int max_idle) :
+				_max_idle(max_idle) {
+
+}
+
+ProcessorPool::~ProcessorPool() {
+
+}
+
+ProcessorPool::Lease ProcessorPool::acquire(int sample_rate, int channels, float tempo_change, int pitch_change) {
+	std::unique_ptr<soundtouch::SoundTouch> processor;
+	{
+		QMutexLocker locker(&_mutex);
+		if(!_idle.empty()) {
+			processor = std::move(_idle.back());
+			_idle.pop_back();
+		}
+	}
+
+	if(!processor) processor = std::unique_ptr<soundtouch::SoundTouch>(new soundtouch::SoundTouch);
+	configure(*processor, sample_rate, channels, tempo_change, pitch_change);
+
+	return Lease(this, std::move(processor));
+}
+
+void ProcessorPool::configure(soundtouch::SoundTouch &processor, int sample_rate, int channels, float tempo_change, int pitch_change) {
+	processor.setSetting(SETTING_USE_QUICKSEEK, 1);
+	processor.setSetting(SETTING_USE_AA_FILTER, 1);
+
+	processor.setSampleRate(sample_rate);
+	processor.setChannels(channels);
+
+	processor.setTempoChange(tempo_change);
+	processor.setPitchSemiTones(pitch_change);
+}
+
+void ProcessorPool::_give_back(std::unique_ptr<soundtouch::SoundTouch> processor) {
+	// leftovers of the previous job must not leak into the next one
+	processor->clear();
+
+	QMutexLocker locker(&_mutex);
+	if((int) _idle.size() < _max_idle) _idle.push_back(std::move(processor));
+}
+
+} /* namespace cb */
@@ -0,0 +1,95 @@
+/*
+ * ProcessorPool.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_PROCESSORPOOL_H_
+#define SRC_SOUNDUTILS_PROCESSORPOOL_H_
+
+#include <memory>
+#include <vector>
+
+#include <QMutex>
+
+#include <soundtouch/SoundTouch.h>
+
+namespace cb {
+
+/**
+ * A thread-safe pool of SoundTouch processors.
+ *
+ * Each job (a render, a preview, an export...) acquires its own processor, configured with the parameters it needs,
+ * and uses it exclusively. When the job is done the processor goes back to the pool so that it can be reused, which
+ * saves the cost of allocating its internal buffers again. Any number of jobs can thus run at the same time.
+ */
+class ProcessorPool {
+public:
+	/**
+	 * Exclusive handle to a processor. The processor is given back to the pool when the lease is destroyed.
+	 */
+	class Lease {
+	public:
+		Lease();
+		Lease(Lease &&other);
+		Lease &operator=(Lease &&other);
+		virtual ~Lease();
+
+		Lease(const Lease &) = delete;
+		Lease &operator=(const Lease &) = delete;
+
+		bool is_valid() const;
+		soundtouch::SoundTouch *operator->() const;
+		soundtouch::SoundTouch &operator*() const;
+
+	private:
+		friend class ProcessorPool;
+		Lease(ProcessorPool *pool, std::unique_ptr<soundtouch::SoundTouch> processor);
+		void _release();
+
+		ProcessorPool *_pool;
+		std::unique_ptr<soundtouch::SoundTouch> _processor;
+	};
+
+	/**
+	 * Return the pool shared by the whole program.
+	 *
+	 * @return
+	 */
+	static ProcessorPool &shared();
+
+	ProcessorPool(int max_idle);
+	virtual ~ProcessorPool();
+
+	ProcessorPool(ProcessorPool const&) = delete;
+	ProcessorPool& operator=(ProcessorPool const&) = delete;
+
+	/**
+	 * Return a processor configured with the given parameters. This method is thread-safe.
+	 *
+	 * @param sample_rate
+	 * @param channels
+	 * @param tempo_change Change in tempo (in percentage)
+	 * @param pitch_change Change in pitch (in number of semitones)
+	 * @return
+	 */
+	Lease acquire(int sample_rate, int channels, float tempo_change, int pitch_change);
+
+	/**
+	 * Apply the settings used throughout the code to a SoundTouch instance.
+	 */
+	static void configure(soundtouch::SoundTouch &processor, int sample_rate, int channels, float tempo_change, int pitch_change);
+
+private:
+	void _give_back(std::unique_ptr<soundtouch::SoundTouch> processor);
+
+	QMutex _mutex;
+	/// Maximum number of idle processors kept around for later use.
+	int _max_idle;
+	std::vector<std::unique_ptr<soundtouch::SoundTouch>> _idle;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_PROCESSORPOOL_H_ */
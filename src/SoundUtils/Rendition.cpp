@@ -0,0 +1,46 @@
+/*
+ * Rendition.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "Rendition.h"
+
+#include "Wave.h"
+
+namespace cb {
+
+Rendition::Rendition() :
+				tempo_change(0.),
+				pitch_change(0),
+				start_us(0),
+				end_us(0) {
+
+}
+
+Rendition::Rendition(std::shared_ptr<Wave> n_wave, qreal n_tempo_change, int n_pitch_change, qint64 n_start_us, qint64 n_end_us) :
+				wave(n_wave),
+				tempo_change(n_tempo_change),
+				pitch_change(n_pitch_change),
+				start_us(n_start_us),
+				end_us(n_end_us) {
+
+}
+
+bool Rendition::is_valid() const {
+	return wave != nullptr;
+}
+
+bool Rendition::covers(qint64 from_us, qint64 to_us) const {
+	return is_valid() && from_us >= start_us && to_us <= end_us;
+}
+
+qint64 Rendition::byte_offset(qint64 original_us) const {
+	qint64 real_us = (original_us - start_us) * 100. / (tempo_change + 100.);
+	qint64 frame = real_us * wave->get_samples_per_sec() / 1000000;
+	qint64 frame_size = wave->get_channels() * wave->get_bytes_per_sample();
+	return qBound((qint64) 0, frame * frame_size, (qint64) wave->get_data_size());
+}
+
+} /* namespace cb */
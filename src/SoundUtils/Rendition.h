@@ -0,0 +1,63 @@
+/*
+ * Rendition.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_RENDITION_H_
+#define SRC_SOUNDUTILS_RENDITION_H_
+
+#include <memory>
+
+#include <QtGlobal>
+#include <QMetaType>
+
+namespace cb {
+
+class Wave;
+
+/**
+ * A processed version of (a region of) a source, together with the information required to map it back to the
+ * original stream.
+ */
+struct Rendition {
+	Rendition();
+	Rendition(std::shared_ptr<Wave> n_wave, qreal n_tempo_change, int n_pitch_change, qint64 n_start_us, qint64 n_end_us);
+
+	bool is_valid() const;
+
+	/**
+	 * Check whether the rendition contains the given interval.
+	 *
+	 * @param from_us Beginning of the interval (in microseconds of the original stream)
+	 * @param to_us End of the interval (in microseconds of the original stream)
+	 * @return true if the rendition is valid and contains the interval, false otherwise
+	 */
+	bool covers(qint64 from_us, qint64 to_us) const;
+
+	/**
+	 * Return the position in the wave of the frame corresponding to the given time. The result is clamped to the
+	 * boundaries of the wave.
+	 *
+	 * @param original_us Time (in microseconds of the original stream)
+	 * @return The position (in bytes)
+	 */
+	qint64 byte_offset(qint64 original_us) const;
+
+	std::shared_ptr<Wave> wave;
+	/// Change in tempo (in percentage)
+	qreal tempo_change;
+	/// Change in pitch (in number of semitones)
+	int pitch_change;
+	/// Position (in microseconds of the original stream) corresponding to the first sample of the wave.
+	qint64 start_us;
+	/// Position (in microseconds of the original stream) corresponding to the end of the wave.
+	qint64 end_us;
+};
+
+} /* namespace cb */
+
+Q_DECLARE_METATYPE(cb::Rendition)
+
+#endif /* SRC_SOUNDUTILS_RENDITION_H_ */
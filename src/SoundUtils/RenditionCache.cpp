@@ -0,0 +1,97 @@
+/*
+ * RenditionCache.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "RenditionCache.h"
+
+#include "Wave.h"
+
+namespace cb {
+
+RenditionCache::RenditionCache(qint64 budget) :
+				_budget(budget),
+				_size(0) {
+
+}
+
+RenditionCache::~RenditionCache() {
+
+}
+
+Rendition RenditionCache::get(qreal tempo_change, int pitch_change) {
+	auto it = _index.find(Key(tempo_change, pitch_change));
+	if(it == _index.end()) return Rendition();
+
+	// move the entry to the front of the list
+	_entries.splice(_entries.begin(), _entries, it->second);
+	return it->second->rendition;
+}
+
+Rendition RenditionCache::peek(qreal tempo_change, int pitch_change) const {
+	auto it = _index.find(Key(tempo_change, pitch_change));
+	if(it == _index.end()) return Rendition();
+
+	return it->second->rendition;
+}
+
+bool RenditionCache::contains(qreal tempo_change, int pitch_change) const {
+	return _index.count(Key(tempo_change, pitch_change)) > 0;
+}
+
+void RenditionCache::insert(const Rendition &rendition) {
+	Key key(rendition.tempo_change, rendition.pitch_change);
+	qint64 rendition_size = rendition.wave->get_data_size();
+
+	auto it = _index.find(key);
+	if(it != _index.end()) {
+		const Rendition &old = it->second->rendition;
+		if(old.covers(rendition.start_us, rendition.end_us)) {
+			_entries.splice(_entries.begin(), _entries, it->second);
+			return;
+		}
+
+		_size -= old.wave->get_data_size();
+		_entries.erase(it->second);
+		_index.erase(it);
+	}
+
+	if(rendition_size > _budget) return;
+
+	_evict(rendition_size);
+	_entries.push_front(Entry { key, rendition });
+	_index[key] = _entries.begin();
+	_size += rendition_size;
+}
+
+void RenditionCache::clear() {
+	_entries.clear();
+	_index.clear();
+	_size = 0;
+}
+
+void RenditionCache::set_budget(qint64 budget) {
+	_budget = budget;
+	_evict(0);
+}
+
+qint64 RenditionCache::budget() const {
+	return _budget;
+}
+
+qint64 RenditionCache::size() const {
+	return _size;
+}
+
+void RenditionCache::_evict(qint64 required) {
+	while(!_entries.empty() && _size + required > _budget) {
+		Entry &last = _entries.back();
+		_size -= last.rendition.wave->get_data_size();
+		_index.erase(last.key);
+		_entries.pop_back();
+	}
+}
+
+} /* namespace cb */
@@ -0,0 +1,80 @@
+/*
+ * RenditionCache.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_RENDITIONCACHE_H_
+#define SRC_SOUNDUTILS_RENDITIONCACHE_H_
+
+#include <memory>
+#include <list>
+#include <map>
+#include <utility>
+
+#include "Rendition.h"
+
+namespace cb {
+
+/**
+ * An in-memory, least-recently-used cache of renditions, keyed by the tempo and pitch changes they have been
+ * generated with. At most one rendition per key is stored.
+ *
+ * The cache holds at most budget() bytes of samples: whenever this threshold is exceeded the renditions that have
+ * not been used for the longest time are dropped.
+ */
+class RenditionCache {
+public:
+	/// Default memory budget (in bytes).
+	static const qint64 DEFAULT_BUDGET = 512 * 1024 * 1024;
+
+	RenditionCache(qint64 budget = DEFAULT_BUDGET);
+	virtual ~RenditionCache();
+
+	/**
+	 * Look for a rendition. If found, the rendition becomes the most recently used one.
+	 *
+	 * @param tempo_change
+	 * @param pitch_change
+	 * @return The rendition, or an invalid rendition if the cache does not contain it
+	 */
+	Rendition get(qreal tempo_change, int pitch_change);
+	/// Like get(), but without affecting the order of the renditions.
+	Rendition peek(qreal tempo_change, int pitch_change) const;
+	bool contains(qreal tempo_change, int pitch_change) const;
+
+	/**
+	 * Add a rendition to the cache, evicting older renditions if required. A rendition replaces the one stored with
+	 * the same key, unless the latter covers a larger portion of the source. Renditions larger than the whole budget
+	 * are not stored.
+	 *
+	 * @param rendition
+	 */
+	void insert(const Rendition &rendition);
+	void clear();
+
+	void set_budget(qint64 budget);
+	qint64 budget() const;
+	/// Number of bytes currently held by the cache.
+	qint64 size() const;
+
+private:
+	using Key = std::pair<qreal, int>;
+	struct Entry {
+		Key key;
+		Rendition rendition;
+	};
+
+	void _evict(qint64 required);
+
+	qint64 _budget;
+	qint64 _size;
+	/// The cached renditions, sorted from the most to the least recently used.
+	std::list<Entry> _entries;
+	std::map<Key, std::list<Entry>::iterator> _index;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_RENDITIONCACHE_H_ */
@@ -0,0 +1,97 @@
+/*
+ * RingBuffer.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "RingBuffer.h"
+
+#include <cstring>
+
+namespace cb {
+
+RingBuffer::RingBuffer(qint64 capacity) :
+				_mask(0),
+				_read_pos(0),
+				_write_pos(0) {
+	reset(capacity);
+}
+
+RingBuffer::~RingBuffer() {
+
+}
+
+void RingBuffer::reset(qint64 capacity) {
+	qint64 real_capacity = 1;
+	while(real_capacity < capacity) real_capacity *= 2;
+
+	_data.assign(real_capacity, 0);
+	_mask = real_capacity - 1;
+	_read_pos = 0;
+	_write_pos = 0;
+}
+
+void RingBuffer::clear() {
+	_read_pos.store(_write_pos.load());
+}
+
+qint64 RingBuffer::capacity() const {
+	return (qint64) _data.size();
+}
+
+qint64 RingBuffer::size() const {
+	return _write_pos.load(std::memory_order_acquire) - _read_pos.load(std::memory_order_acquire);
+}
+
+qint64 RingBuffer::free_space() const {
+	return capacity() - size();
+}
+
+qint64 RingBuffer::read_position() const {
+	return _read_pos.load(std::memory_order_acquire);
+}
+
+qint64 RingBuffer::write_position() const {
+	return _write_pos.load(std::memory_order_acquire);
+}
+
+qint64 RingBuffer::write(const char *data, qint64 len) {
+	qint64 write_pos = _write_pos.load(std::memory_order_relaxed);
+	qint64 read_pos = _read_pos.load(std::memory_order_acquire);
+	qint64 n_bytes = qMin(len, capacity() - (write_pos - read_pos));
+	if(n_bytes <= 0) return 0;
+
+	// the region to be written might wrap around the end of the storage
+	qint64 start = write_pos & _mask;
+	qint64 first_part = qMin(n_bytes, capacity() - start);
+	memcpy(_data.data() + start, data, first_part);
+	memcpy(_data.data(), data + first_part, n_bytes - first_part);
+
+	_write_pos.store(write_pos + n_bytes, std::memory_order_release);
+	return n_bytes;
+}
+
+qint64 RingBuffer::read(char *data, qint64 len) {
+	qint64 read_pos = _read_pos.load(std::memory_order_relaxed);
+	qint64 write_pos = _write_pos.load(std::memory_order_acquire);
+	qint64 n_bytes = qMin(len, write_pos - read_pos);
+	if(n_bytes <= 0) return 0;
+
+	qint64 start = read_pos & _mask;
+	qint64 first_part = qMin(n_bytes, capacity() - start);
+	memcpy(data, _data.data() + start, first_part);
+	memcpy(data + first_part, _data.data(), n_bytes - first_part);
+
+	_read_pos.store(read_pos + n_bytes, std::memory_order_release);
+	return n_bytes;
+}
+
+void RingBuffer::discard(qint64 position) {
+	qint64 read_pos = _read_pos.load(std::memory_order_relaxed);
+	qint64 write_pos = _write_pos.load(std::memory_order_acquire);
+	qint64 new_read_pos = qMin(position, write_pos);
+	if(new_read_pos > read_pos) _read_pos.store(new_read_pos, std::memory_order_release);
+}
+
+} /* namespace cb */
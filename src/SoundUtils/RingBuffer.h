@@ -0,0 +1,84 @@
+/*
+ * RingBuffer.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_RINGBUFFER_H_
+#define SRC_SOUNDUTILS_RINGBUFFER_H_
+
+#include <vector>
+#include <atomic>
+
+#include <QtGlobal>
+
+namespace cb {
+
+/**
+ * A fixed-size, wait-free ring of bytes shared by exactly one producer thread and one consumer thread.
+ *
+ * write() must only be called by the producer and read() only by the consumer. Neither locks nor allocates, so
+ * that the consumer can safely be the real-time side of an audio pipeline. reset() and clear() must only be
+ * called when neither side is accessing the buffer.
+ */
+class RingBuffer {
+public:
+	RingBuffer(qint64 capacity = 0);
+	virtual ~RingBuffer();
+
+	/**
+	 * Drop the content of the buffer and change its capacity, which is rounded up to the next power of two.
+	 *
+	 * @param capacity Minimum capacity (in bytes)
+	 */
+	void reset(qint64 capacity);
+	/// Drop the content of the buffer.
+	void clear();
+
+	qint64 capacity() const;
+	/// Number of bytes that can be read.
+	qint64 size() const;
+	/// Number of bytes that can be written.
+	qint64 free_space() const;
+	/// Total number of bytes read so far.
+	qint64 read_position() const;
+	/// Total number of bytes written so far.
+	qint64 write_position() const;
+
+	/**
+	 * Append at most len bytes to the buffer. Producer side only.
+	 *
+	 * @param data
+	 * @param len
+	 * @return The number of bytes actually written
+	 */
+	qint64 write(const char *data, qint64 len);
+
+	/**
+	 * Remove at most len bytes from the buffer. Consumer side only.
+	 *
+	 * @param data
+	 * @param len
+	 * @return The number of bytes actually read
+	 */
+	qint64 read(char *data, qint64 len);
+
+	/**
+	 * Drop the bytes that precede the given position, or whatever has been written if the position has not been
+	 * reached yet. Consumer side only.
+	 *
+	 * @param position A total number of bytes written, as returned by write_position()
+	 */
+	void discard(qint64 position);
+
+private:
+	std::vector<char> _data;
+	qint64 _mask;
+	/// Total number of bytes read and written so far. Their difference is the number of bytes stored.
+	std::atomic<qint64> _read_pos, _write_pos;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_RINGBUFFER_H_ */
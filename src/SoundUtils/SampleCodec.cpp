@@ -0,0 +1,280 @@
+/*
+ * SampleCodec.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "SampleCodec.h"
+
+#include "SampleConversion.h"
+
+#include <cstring>
+#include <stdint.h>
+
+namespace cb {
+
+namespace {
+
+/**
+ * Scale a float, clamp it to [min, max] and truncate it towards zero. Scaling by a power of two is exact, and doubles
+ * can represent all the boundaries of 32-bit integers.
+ */
+inline int32_t to_integer(float value, double scale, int32_t min, int32_t max) {
+	double scaled = value * scale;
+	if(scaled >= max) return max;
+	if(scaled <= min) return min;
+	// NaNs fail both the comparisons above
+	if(scaled != scaled) return 0;
+	return (int32_t) scaled;
+}
+
+// The sample formats. Each one converts a single sample from and to float, and is meant to be inlined in the loops
+// of InterleavedCodec.
+
+struct UInt8Sample {
+	static const int BYTES = 1;
+
+	static inline float decode(const char *in) {
+		return ((int) (uint8_t) *in - 128) * (1.f / 128.f);
+	}
+
+	static inline void encode(float value, char *out) {
+		*out = (char) (uint8_t) (to_integer(value, 128., -128, 127) + 128);
+	}
+};
+
+struct Int16Sample {
+	static const int BYTES = 2;
+
+	static inline float decode(const char *in) {
+		int16_t value;
+		memcpy(&value, in, BYTES);
+		return value * (1.f / 32768.f);
+	}
+
+	static inline void encode(float value, char *out) {
+		int16_t sample = to_integer(value, 32768., -32768, 32767);
+		memcpy(out, &sample, BYTES);
+	}
+};
+
+struct Int24Sample {
+	static const int BYTES = 3;
+
+	static inline float decode(const char *in) {
+		// the sample goes to the upper 24 bits, and the arithmetic shift extends its sign
+		uint32_t bits = ((uint32_t) (uint8_t) in[0] << 8) | ((uint32_t) (uint8_t) in[1] << 16) | ((uint32_t) (uint8_t) in[2] << 24);
+		return ((int32_t) bits >> 8) * (1.f / 8388608.f);
+	}
+
+	static inline void encode(float value, char *out) {
+		int32_t sample = to_integer(value, 8388608., -8388608, 8388607);
+		out[0] = (char) (sample & 0xFF);
+		out[1] = (char) ((sample >> 8) & 0xFF);
+		out[2] = (char) ((sample >> 16) & 0xFF);
+	}
+};
+
+struct Int32Sample {
+	static const int BYTES = 4;
+
+	static inline float decode(const char *in) {
+		int32_t value;
+		memcpy(&value, in, BYTES);
+		return (float) (value * (1. / 2147483648.));
+	}
+
+	static inline void encode(float value, char *out) {
+		int32_t sample = to_integer(value, 2147483648., INT32_MIN, INT32_MAX);
+		memcpy(out, &sample, BYTES);
+	}
+};
+
+struct Float32Sample {
+	static const int BYTES = 4;
+
+	static inline float decode(const char *in) {
+		float value;
+		memcpy(&value, in, BYTES);
+		return value;
+	}
+
+	static inline void encode(float value, char *out) {
+		memcpy(out, &value, BYTES);
+	}
+};
+
+/**
+ * Conversion loops for interleaved samples. With the number of channels known at compile time, the loop over the
+ * samples of a frame is unrolled and the offsets of the samples become constants.
+ */
+template<typename Sample, int CHANNELS>
+struct InterleavedCodec {
+	static void decode(const char *in, float *out, qint64 n_samples) {
+		qint64 n_frames = n_samples / CHANNELS;
+		for(qint64 frame = 0; frame < n_frames; frame++) {
+			for(int channel = 0; channel < CHANNELS; channel++) {
+				out[channel] = Sample::decode(in + channel * Sample::BYTES);
+			}
+			in += CHANNELS * Sample::BYTES;
+			out += CHANNELS;
+		}
+		// the samples that do not make up a whole frame
+		for(qint64 i = n_frames * CHANNELS; i < n_samples; i++, in += Sample::BYTES) {
+			*out++ = Sample::decode(in);
+		}
+	}
+
+	static void encode(const float *in, char *out, qint64 n_samples) {
+		qint64 n_frames = n_samples / CHANNELS;
+		for(qint64 frame = 0; frame < n_frames; frame++) {
+			for(int channel = 0; channel < CHANNELS; channel++) {
+				Sample::encode(in[channel], out + channel * Sample::BYTES);
+			}
+			in += CHANNELS;
+			out += CHANNELS * Sample::BYTES;
+		}
+		for(qint64 i = n_frames * CHANNELS; i < n_samples; i++, out += Sample::BYTES) {
+			Sample::encode(*in++, out);
+		}
+	}
+};
+
+/// 16-bit samples are converted by the vectorised kernels, which do not care about channels.
+template<int CHANNELS>
+struct InterleavedCodec<Int16Sample, CHANNELS> {
+	static void decode(const char *in, float *out, qint64 n_samples) {
+		SampleConversion::to_float(reinterpret_cast<const int16_t *>(in), out, n_samples);
+	}
+
+	static void encode(const float *in, char *out, qint64 n_samples) {
+		SampleConversion::to_int16(in, reinterpret_cast<int16_t *>(out), n_samples);
+	}
+};
+
+template<typename Sample>
+void select_functions(int channels, SampleCodec::DecodeFunction &decode, SampleCodec::EncodeFunction &encode) {
+	switch(channels) {
+	case 2:
+		decode = &InterleavedCodec<Sample, 2>::decode;
+		encode = &InterleavedCodec<Sample, 2>::encode;
+		break;
+	default:
+		// mono, and the layouts that are too rare to deserve their own loops
+		decode = &InterleavedCodec<Sample, 1>::decode;
+		encode = &InterleavedCodec<Sample, 1>::encode;
+		break;
+	}
+}
+
+} /* namespace */
+
+SampleCodec::SampleCodec() :
+				_format(INT16),
+				_decode(nullptr),
+				_encode(nullptr) {
+
+}
+
+SampleCodec::SampleCodec(Format format, int channels) :
+				_format(format) {
+	switch(format) {
+	case UINT8:
+		select_functions<UInt8Sample>(channels, _decode, _encode);
+		break;
+	case INT16:
+		select_functions<Int16Sample>(channels, _decode, _encode);
+		break;
+	case INT24:
+		select_functions<Int24Sample>(channels, _decode, _encode);
+		break;
+	case INT32:
+		select_functions<Int32Sample>(channels, _decode, _encode);
+		break;
+	case FLOAT32:
+		select_functions<Float32Sample>(channels, _decode, _encode);
+		break;
+	}
+}
+
+bool SampleCodec::is_valid() const {
+	return _decode != nullptr;
+}
+
+SampleCodec::Format SampleCodec::format() const {
+	return _format;
+}
+
+int SampleCodec::bytes_per_sample() const {
+	return bytes_per_sample(_format);
+}
+
+void SampleCodec::decode(const char *in, float *out, qint64 n_samples) const {
+	_decode(in, out, n_samples);
+}
+
+void SampleCodec::encode(const float *in, char *out, qint64 n_samples) const {
+	_encode(in, out, n_samples);
+}
+
+bool SampleCodec::format_of(int format_tag, int bits_per_sample, Format &format) {
+	// WAVE_FORMAT_PCM
+	if(format_tag == 1) {
+		switch(bits_per_sample) {
+		case 8:
+			format = UINT8;
+			return true;
+		case 16:
+			format = INT16;
+			return true;
+		case 24:
+			format = INT24;
+			return true;
+		case 32:
+			format = INT32;
+			return true;
+		}
+	}
+	// WAVE_FORMAT_IEEE_FLOAT
+	else if(format_tag == 3 && bits_per_sample == 32) {
+		format = FLOAT32;
+		return true;
+	}
+
+	return false;
+}
+
+int SampleCodec::bytes_per_sample(Format format) {
+	switch(format) {
+	case UINT8:
+		return UInt8Sample::BYTES;
+	case INT16:
+		return Int16Sample::BYTES;
+	case INT24:
+		return Int24Sample::BYTES;
+	case INT32:
+		return Int32Sample::BYTES;
+	case FLOAT32:
+		return Float32Sample::BYTES;
+	}
+	return 0;
+}
+
+const char *SampleCodec::format_name(Format format) {
+	switch(format) {
+	case UINT8:
+		return "uint8";
+	case INT16:
+		return "int16";
+	case INT24:
+		return "int24";
+	case INT32:
+		return "int32";
+	case FLOAT32:
+		return "float32";
+	}
+	return "unknown";
+}
+
+} /* namespace cb */
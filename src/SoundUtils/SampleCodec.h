@@ -0,0 +1,87 @@
+/*
+ * SampleCodec.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_SAMPLECODEC_H_
+#define SRC_SOUNDUTILS_SAMPLECODEC_H_
+
+#include <QtGlobal>
+
+namespace cb {
+
+/**
+ * Conversions between the samples stored in wav files and floats in [-1, 1). Integer samples are scaled by
+ * 2^-(bits - 1), 8-bit samples being unsigned with 128 as zero. The other way round, floats are scaled, clamped to the
+ * range of the format and truncated towards zero, as SampleConversion does for 16-bit samples, and NaNs are converted
+ * to 0. 32-bit float samples are copied as they are.
+ *
+ * The conversion loops are templates specialised at compile time on the sample format and on the number of channels
+ * (mono and stereo get their own unrolled loops, the other layouts are converted one sample at a time). A codec
+ * just picks the right instantiation once, when it is built. 16-bit samples go through the vectorised
+ * SampleConversion kernels.
+ */
+class SampleCodec {
+public:
+	enum Format {
+		/// Unsigned 8-bit integers.
+		UINT8,
+		INT16,
+		/// Packed 24-bit integers (3 bytes per sample).
+		INT24,
+		INT32,
+		/// IEEE 754 32-bit floats.
+		FLOAT32
+	};
+
+	typedef void (*DecodeFunction)(const char *in, float *out, qint64 n_samples);
+	typedef void (*EncodeFunction)(const float *in, char *out, qint64 n_samples);
+
+	/// An invalid codec, which cannot convert anything.
+	SampleCodec();
+	SampleCodec(Format format, int channels);
+
+	bool is_valid() const;
+	Format format() const;
+	int bytes_per_sample() const;
+
+	/**
+	 * Convert interleaved samples to floats.
+	 *
+	 * @param in
+	 * @param out Buffer with room for at least n_samples samples
+	 * @param n_samples Number of samples, all channels included
+	 */
+	void decode(const char *in, float *out, qint64 n_samples) const;
+	/**
+	 * Convert interleaved float samples to the format of the codec.
+	 *
+	 * @param in
+	 * @param out Buffer with room for at least n_samples * bytes_per_sample() bytes
+	 * @param n_samples Number of samples, all channels included
+	 */
+	void encode(const float *in, char *out, qint64 n_samples) const;
+
+	/**
+	 * Find out the format of the samples of a wav file.
+	 *
+	 * @param format_tag Either WAVE_FORMAT_PCM (1) or WAVE_FORMAT_IEEE_FLOAT (3)
+	 * @param bits_per_sample
+	 * @param format Set to the format, if it is supported
+	 * @return false if the samples cannot be converted
+	 */
+	static bool format_of(int format_tag, int bits_per_sample, Format &format);
+	static int bytes_per_sample(Format format);
+	static const char *format_name(Format format);
+
+private:
+	Format _format;
+	DecodeFunction _decode;
+	EncodeFunction _encode;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_SAMPLECODEC_H_ */
@@ -0,0 +1,252 @@
+/*
+ * SampleConversion.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "SampleConversion.h"
+
+#include <stdexcept>
+#include <string>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CB_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace cb {
+
+namespace {
+
+const float TO_FLOAT_SCALE = 1.f / 32768.f;
+const float TO_INT16_SCALE = 32768.f;
+const float INT16_MIN_F = -32768.f;
+const float INT16_MAX_F = 32767.f;
+
+using ToFloatKernel = void (*)(const int16_t *, float *, qint64);
+using ToInt16Kernel = void (*)(const float *, int16_t *, qint64);
+
+void to_float_scalar(const int16_t *in, float *out, qint64 n_samples) {
+	// multiplying by a power of two is exact, hence the result does not depend on the precision of the computation
+	for(qint64 i = 0; i < n_samples; i++) {
+		out[i] = in[i] * TO_FLOAT_SCALE;
+	}
+}
+
+void to_int16_scalar(const float *in, int16_t *out, qint64 n_samples) {
+	for(qint64 i = 0; i < n_samples; i++) {
+		float value = in[i] * TO_INT16_SCALE;
+		if(value > INT16_MAX_F) value = INT16_MAX_F;
+		else if(value < INT16_MIN_F) value = INT16_MIN_F;
+		else if(value != value) value = 0.f;
+		out[i] = (int16_t) value;
+	}
+}
+
+#ifdef CB_X86_KERNELS
+
+// The vectorised kernels handle as many samples as possible in blocks and leave the rest to the scalar ones. Each
+// of them is compiled for its own instruction set, so that the rest of the program does not depend on it.
+
+__attribute__((target("sse2")))
+void to_float_sse2(const int16_t *in, float *out, qint64 n_samples) {
+	const __m128 scale = _mm_set1_ps(TO_FLOAT_SCALE);
+	qint64 i = 0;
+	for(; i + 8 <= n_samples; i += 8) {
+		__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		// sign-extend by moving each sample to the upper half of a 32-bit lane and shifting it back
+		__m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+		__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+	}
+	to_float_scalar(in + i, out + i, n_samples - i);
+}
+
+__attribute__((target("sse2")))
+inline __m128i to_int32_sse2(__m128 values) {
+	// NaNs are zeroed, since comparisons with them are always false
+	values = _mm_and_ps(values, _mm_cmpord_ps(values, values));
+	values = _mm_min_ps(_mm_max_ps(values, _mm_set1_ps(INT16_MIN_F)), _mm_set1_ps(INT16_MAX_F));
+	return _mm_cvttps_epi32(values);
+}
+
+__attribute__((target("sse2")))
+void to_int16_sse2(const float *in, int16_t *out, qint64 n_samples) {
+	const __m128 scale = _mm_set1_ps(TO_INT16_SCALE);
+	qint64 i = 0;
+	for(; i + 8 <= n_samples; i += 8) {
+		__m128i low = to_int32_sse2(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+		__m128i high = to_int32_sse2(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(low, high));
+	}
+	to_int16_scalar(in + i, out + i, n_samples - i);
+}
+
+__attribute__((target("avx2")))
+void to_float_avx2(const int16_t *in, float *out, qint64 n_samples) {
+	const __m256 scale = _mm256_set1_ps(TO_FLOAT_SCALE);
+	qint64 i = 0;
+	for(; i + 16 <= n_samples; i += 16) {
+		__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 8));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(low)), scale));
+		_mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(high)), scale));
+	}
+	to_float_scalar(in + i, out + i, n_samples - i);
+}
+
+__attribute__((target("avx2")))
+inline __m256i to_int32_avx2(__m256 values) {
+	values = _mm256_and_ps(values, _mm256_cmp_ps(values, values, _CMP_ORD_Q));
+	values = _mm256_min_ps(_mm256_max_ps(values, _mm256_set1_ps(INT16_MIN_F)), _mm256_set1_ps(INT16_MAX_F));
+	return _mm256_cvttps_epi32(values);
+}
+
+__attribute__((target("avx2")))
+void to_int16_avx2(const float *in, int16_t *out, qint64 n_samples) {
+	const __m256 scale = _mm256_set1_ps(TO_INT16_SCALE);
+	qint64 i = 0;
+	for(; i + 16 <= n_samples; i += 16) {
+		__m256i low = to_int32_avx2(_mm256_mul_ps(_mm256_loadu_ps(in + i), scale));
+		__m256i high = to_int32_avx2(_mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale));
+		// packing works within 128-bit lanes, so the 64-bit blocks have to be put back in order
+		__m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(low, high), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), packed);
+	}
+	to_int16_scalar(in + i, out + i, n_samples - i);
+}
+
+__attribute__((target("avx512f")))
+void to_float_avx512(const int16_t *in, float *out, qint64 n_samples) {
+	const __m512 scale = _mm512_set1_ps(TO_FLOAT_SCALE);
+	qint64 i = 0;
+	for(; i + 16 <= n_samples; i += 16) {
+		__m256i samples = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+		_mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(samples)), scale));
+	}
+	to_float_scalar(in + i, out + i, n_samples - i);
+}
+
+__attribute__((target("avx512f")))
+void to_int16_avx512(const float *in, int16_t *out, qint64 n_samples) {
+	const __m512 scale = _mm512_set1_ps(TO_INT16_SCALE);
+	const __m512 min_value = _mm512_set1_ps(INT16_MIN_F);
+	const __m512 max_value = _mm512_set1_ps(INT16_MAX_F);
+	qint64 i = 0;
+	for(; i + 16 <= n_samples; i += 16) {
+		__m512 values = _mm512_mul_ps(_mm512_loadu_ps(in + i), scale);
+		// only the lanes that are not NaN are kept, the others are zeroed
+		values = _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(values, values, _CMP_ORD_Q), values);
+		values = _mm512_min_ps(_mm512_max_ps(values, min_value), max_value);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm512_cvtsepi32_epi16(_mm512_cvttps_epi32(values)));
+	}
+	to_int16_scalar(in + i, out + i, n_samples - i);
+}
+
+#endif
+
+ToFloatKernel to_float_kernel(SampleConversion::Kernel kernel) {
+	switch(kernel) {
+#ifdef CB_X86_KERNELS
+	case SampleConversion::SSE2:
+		return to_float_sse2;
+	case SampleConversion::AVX2:
+		return to_float_avx2;
+	case SampleConversion::AVX512:
+		return to_float_avx512;
+#endif
+	default:
+		return to_float_scalar;
+	}
+}
+
+ToInt16Kernel to_int16_kernel(SampleConversion::Kernel kernel) {
+	switch(kernel) {
+#ifdef CB_X86_KERNELS
+	case SampleConversion::SSE2:
+		return to_int16_sse2;
+	case SampleConversion::AVX2:
+		return to_int16_avx2;
+	case SampleConversion::AVX512:
+		return to_int16_avx512;
+#endif
+	default:
+		return to_int16_scalar;
+	}
+}
+
+void check_supported(SampleConversion::Kernel kernel) {
+	if(!SampleConversion::is_supported(kernel)) {
+		throw std::runtime_error(std::string("Conversion kernel '") + SampleConversion::kernel_name(kernel) + "' is not supported by this CPU");
+	}
+}
+
+} /* namespace */
+
+void SampleConversion::to_float(const int16_t *in, float *out, qint64 n_samples) {
+	// resolved once, the first time a conversion is performed
+	static const ToFloatKernel kernel = to_float_kernel(default_kernel());
+	kernel(in, out, n_samples);
+}
+
+void SampleConversion::to_int16(const float *in, int16_t *out, qint64 n_samples) {
+	static const ToInt16Kernel kernel = to_int16_kernel(default_kernel());
+	kernel(in, out, n_samples);
+}
+
+void SampleConversion::to_float(Kernel kernel, const int16_t *in, float *out, qint64 n_samples) {
+	check_supported(kernel);
+	to_float_kernel(kernel)(in, out, n_samples);
+}
+
+void SampleConversion::to_int16(Kernel kernel, const float *in, int16_t *out, qint64 n_samples) {
+	check_supported(kernel);
+	to_int16_kernel(kernel)(in, out, n_samples);
+}
+
+SampleConversion::Kernel SampleConversion::default_kernel() {
+	return supported_kernels().back();
+}
+
+bool SampleConversion::is_supported(Kernel kernel) {
+	switch(kernel) {
+	case SCALAR:
+		return true;
+#ifdef CB_X86_KERNELS
+	case SSE2:
+		return __builtin_cpu_supports("sse2");
+	case AVX2:
+		return __builtin_cpu_supports("avx2");
+	case AVX512:
+		return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+		return false;
+	}
+}
+
+std::vector<SampleConversion::Kernel> SampleConversion::supported_kernels() {
+	std::vector<Kernel> kernels;
+	for(Kernel kernel : { SCALAR, SSE2, AVX2, AVX512 }) {
+		if(is_supported(kernel)) kernels.push_back(kernel);
+	}
+	return kernels;
+}
+
+const char *SampleConversion::kernel_name(Kernel kernel) {
+	switch(kernel) {
+	case SCALAR:
+		return "scalar";
+	case SSE2:
+		return "sse2";
+	case AVX2:
+		return "avx2";
+	case AVX512:
+		return "avx512";
+	}
+	return "unknown";
+}
+
+} /* namespace cb */
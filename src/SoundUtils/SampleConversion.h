@@ -0,0 +1,68 @@
+/*
+ * SampleConversion.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_SAMPLECONVERSION_H_
+#define SRC_SOUNDUTILS_SAMPLECONVERSION_H_
+
+#include <QtGlobal>
+
+#include <vector>
+#include <stdint.h>
+
+namespace cb {
+
+/**
+ * Conversions between 16-bit and float samples. Floats are in [-1, 1): 16-bit samples are scaled by 1/32768 and,
+ * the other way round, floats are scaled by 32768, clamped to [-32768, 32767] and truncated towards zero. NaNs are
+ * converted to 0, whereas the scalar loops these conversions replaced cast them to int, which is undefined.
+ *
+ * Each conversion comes with a scalar kernel and with vectorised SSE2, AVX2 and AVX-512 kernels. The kernel used by
+ * default is the fastest one supported by the CPU the program runs on, and all the kernels give exactly the same
+ * results.
+ */
+class SampleConversion {
+public:
+	enum Kernel {
+		SCALAR,
+		SSE2,
+		AVX2,
+		AVX512
+	};
+
+	/**
+	 * Convert 16-bit samples to floats, using the default kernel.
+	 *
+	 * @param in
+	 * @param out Buffer with room for at least n_samples samples
+	 * @param n_samples
+	 */
+	static void to_float(const int16_t *in, float *out, qint64 n_samples);
+	/**
+	 * Convert float samples to 16 bits, saturating the values that are out of range, using the default kernel.
+	 *
+	 * @param in
+	 * @param out Buffer with room for at least n_samples samples
+	 * @param n_samples
+	 */
+	static void to_int16(const float *in, int16_t *out, qint64 n_samples);
+
+	/// Like to_float(const int16_t *, float *, qint64), but with the given kernel, which must be supported.
+	static void to_float(Kernel kernel, const int16_t *in, float *out, qint64 n_samples);
+	/// Like to_int16(const float *, int16_t *, qint64), but with the given kernel, which must be supported.
+	static void to_int16(Kernel kernel, const float *in, int16_t *out, qint64 n_samples);
+
+	/// The kernel used by default.
+	static Kernel default_kernel();
+	static bool is_supported(Kernel kernel);
+	/// All the kernels supported by the CPU, from the slowest to the fastest one.
+	static std::vector<Kernel> supported_kernels();
+	static const char *kernel_name(Kernel kernel);
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_SAMPLECONVERSION_H_ */
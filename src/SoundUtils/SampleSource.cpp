@@ -0,0 +1,30 @@
+/*
+ * SampleSource.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "SampleSource.h"
+
+namespace cb {
+
+SampleSource::~SampleSource() {
+
+}
+
+const float *SampleSource::samples(qint64 offset, qint64 n_samples) const {
+	Q_UNUSED(offset);
+	Q_UNUSED(n_samples);
+	return nullptr;
+}
+
+qint64 SampleSource::n_frames() const {
+	return n_samples() / channels();
+}
+
+qint64 SampleSource::duration_us() const {
+	return n_frames() * 1000000 / sample_rate();
+}
+
+} /* namespace cb */
@@ -0,0 +1,56 @@
+/*
+ * SampleSource.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_SAMPLESOURCE_H_
+#define SRC_SOUNDUTILS_SAMPLESOURCE_H_
+
+#include <QtGlobal>
+
+namespace cb {
+
+/**
+ * Interleaved audio samples that can be read as floats in [-1, 1), which is what SoundTouch works with. Sample
+ * positions always include all the channels.
+ *
+ * Implementations must allow concurrent reads from several threads.
+ */
+class SampleSource {
+public:
+	virtual ~SampleSource();
+
+	virtual int channels() const = 0;
+	virtual int sample_rate() const = 0;
+	/// Number of samples, all channels included.
+	virtual qint64 n_samples() const = 0;
+
+	/**
+	 * Copy samples into a buffer provided by the caller.
+	 *
+	 * @param offset Position of the first sample
+	 * @param n_samples Number of samples to be read
+	 * @param dest Buffer with room for at least n_samples samples
+	 * @return The number of samples read, which is smaller than n_samples only at the end of the source
+	 */
+	virtual qint64 read(qint64 offset, qint64 n_samples, float *dest) const = 0;
+
+	/**
+	 * Direct access to samples that are kept in memory, which saves the copy made by read(). The default
+	 * implementation returns nullptr, meaning that direct access is not supported.
+	 *
+	 * @param offset Position of the first sample
+	 * @param n_samples Number of samples the caller is going to access. It must not go past the end of the source
+	 * @return A pointer to the sample at the given position, or nullptr
+	 */
+	virtual const float *samples(qint64 offset, qint64 n_samples) const;
+
+	qint64 n_frames() const;
+	qint64 duration_us() const;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_SAMPLESOURCE_H_ */
@@ -0,0 +1,63 @@
+/*
+ * SampleStore.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "SampleStore.h"
+
+#include "Wave.h"
+
+#include <algorithm>
+
+namespace cb {
+
+SampleStore::SampleStore(const Wave &wave) :
+				_channels(wave.get_channels()),
+				_sample_rate(wave.get_samples_per_sec()) {
+	_samples.reserve(wave.get_n_samples());
+	wave.get_samples(0, wave.get_n_samples(), _samples);
+}
+
+SampleStore::SampleStore(int channels, int sample_rate, std::vector<float> &&samples) :
+				_channels(channels),
+				_sample_rate(sample_rate),
+				_samples(std::move(samples)) {
+
+}
+
+SampleStore::~SampleStore() {
+
+}
+
+int SampleStore::channels() const {
+	return _channels;
+}
+
+int SampleStore::sample_rate() const {
+	return _sample_rate;
+}
+
+qint64 SampleStore::n_samples() const {
+	return _samples.size();
+}
+
+qint64 SampleStore::read(qint64 offset, qint64 n_samples, float *dest) const {
+	if(offset < 0 || offset >= (qint64) _samples.size()) return 0;
+
+	n_samples = std::min(n_samples, (qint64) _samples.size() - offset);
+	std::copy(_samples.begin() + offset, _samples.begin() + offset + n_samples, dest);
+	return n_samples;
+}
+
+const float *SampleStore::samples(qint64 offset, qint64 n_samples) const {
+	Q_UNUSED(n_samples);
+	return _samples.data() + offset;
+}
+
+qint64 SampleStore::size() const {
+	return _samples.size() * sizeof(float);
+}
+
+} /* namespace cb */
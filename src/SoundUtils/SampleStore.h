@@ -0,0 +1,48 @@
+/*
+ * SampleStore.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_SAMPLESTORE_H_
+#define SRC_SOUNDUTILS_SAMPLESTORE_H_
+
+#include <vector>
+
+#include "SampleSource.h"
+
+namespace cb {
+
+class Wave;
+
+/**
+ * An in-memory copy of a source converted to 32-bit floats once and for all, so that every render can feed
+ * SoundTouch straight from memory instead of converting the samples of a Wave over and over again. The
+ * 16-bit Wave is still what goes to the audio device.
+ */
+class SampleStore: public SampleSource {
+public:
+	SampleStore(const Wave &wave);
+	/// Take over samples that have been decoded elsewhere.
+	SampleStore(int channels, int sample_rate, std::vector<float> &&samples);
+	virtual ~SampleStore();
+
+	virtual int channels() const;
+	virtual int sample_rate() const;
+	virtual qint64 n_samples() const;
+	virtual qint64 read(qint64 offset, qint64 n_samples, float *dest) const;
+	virtual const float *samples(qint64 offset, qint64 n_samples) const;
+
+	/// Number of bytes taken by the samples.
+	qint64 size() const;
+
+private:
+	int _channels;
+	int _sample_rate;
+	std::vector<float> _samples;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_SAMPLESTORE_H_ */
@@ -8,22 +8,24 @@
 #include "SoundUtils.h"
 
 #include "Wave.h"
+#include "SampleSource.h"
+#include "ProcessorPool.h"
+#include "../Tracer.h"
 
 #include <QByteArray>
 #include <QDataStream>
 #include <QAudioFormat>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
 
 namespace cb {
 
-SoundUtils::SoundUtils() {
-	pSoundTouch.setSetting(SETTING_USE_QUICKSEEK, 1);
-	pSoundTouch.setSetting(SETTING_USE_AA_FILTER, 1);
-}
-
-SoundUtils::~SoundUtils() {
-
-}
+// std::make_shared() takes it by reference, hence it needs a definition
+const int SoundUtils::OUTPUT_BITS_PER_SAMPLE;
 
 qint64 SoundUtils::audio_length(QAudioFormat &format, qint64 microseconds) {
 	qint64 result = (format.sampleRate() * format.channelCount() * (format.sampleSize() / 8)) * microseconds / 1000000;
@@ -37,54 +39,366 @@ qreal SoundUtils::pcmToReal(QAudioFormat &format, int pcm) {
 }
 
 #define N_SAMPLES 1024
-std::unique_ptr<Wave> SoundUtils::process(Wave &in_file, float tempo_change, int pitch_change) {
-	int nChannels = (int) in_file.get_channels();
-
-	pSoundTouch.setSampleRate(in_file.get_samples_per_sec());
-	pSoundTouch.setChannels(nChannels);
-
-	pSoundTouch.setTempoChange(tempo_change);
-	pSoundTouch.setPitchSemiTones(pitch_change);
+bool SoundUtils::stretch(const SampleSource &source, soundtouch::SoundTouch &stretcher, qint64 first_sample, qint64 last_sample, qint64 frames_to_skip, qint64 frames_to_keep, const SampleSink &sink, const std::function<bool(qint64)> &progress_callback) {
+	int nChannels = source.channels();
 
 	float sampleBuffer[N_SAMPLES];
 
 	int samples_per_channel;
 	int buffSizeSamples = N_SAMPLES / nChannels;
 
-	std::unique_ptr<Wave> out(new Wave(nChannels, in_file.get_samples_per_sec(), in_file.get_bits_per_sample()));
+	// Read ready samples from SoundTouch processor & write them output file, skipping the pre-roll.
+	// NOTES:
+	// - 'receiveSamples' doesn't necessarily return any samples at all
+	//   during some rounds!
+	// - On the other hand, during some round 'receiveSamples' may have more
+	//   ready samples than would fit into 'sampleBuffer', and for this reason
+	//   the 'receiveSamples' call is iterated for as many times as it
+	//   outputs samples.
+	auto receive_samples = [&]() {
+		do {
+			samples_per_channel = stretcher.receiveSamples(sampleBuffer, buffSizeSamples);
+			qint64 skipped = std::min((qint64) samples_per_channel, frames_to_skip);
+			qint64 kept = std::min(samples_per_channel - skipped, frames_to_keep);
+			frames_to_skip -= skipped;
+			frames_to_keep -= kept;
+			if(kept > 0) sink(sampleBuffer + skipped * nChannels, nChannels * kept);
+		} while(samples_per_channel != 0);
+	};
+
+	// call the progress callback roughly once per second of audio
+	int callback_every = std::max(1, source.sample_rate() * nChannels / N_SAMPLES);
+	int n_chunks = 0;
+	// only used if the source cannot be accessed directly
+	std::vector<float> buffer;
 	// Process samples read from the input file
-	for(int i = 0; i < in_file.get_n_samples(); i += N_SAMPLES) {
+	for(qint64 i = first_sample; i < last_sample && frames_to_keep > 0; i += N_SAMPLES, n_chunks++) {
+		if(progress_callback && (n_chunks % callback_every) == 0) {
+			if(!progress_callback(i - first_sample)) {
+				stretcher.clear();
+				return false;
+			}
+		}
+
 		// Read a chunk of samples from the input file
-		std::vector<float> samples;
-		int samples_read = in_file.get_samples(i, N_SAMPLES, samples);
-		samples_per_channel = samples_read / nChannels;
+		qint64 n_samples = std::min((qint64) N_SAMPLES, last_sample - i);
+		const float *samples = source.samples(i, n_samples);
+		if(samples == nullptr) {
+			buffer.resize(N_SAMPLES);
+			n_samples = source.read(i, n_samples, buffer.data());
+			samples = buffer.data();
+		}
+		samples_per_channel = n_samples / nChannels;
 
 		// Feed the samples into SoundTouch processor
-		pSoundTouch.putSamples(samples.data(), samples_per_channel);
-
-		// Read ready samples from SoundTouch processor & write them output file.
-		// NOTES:
-		// - 'receiveSamples' doesn't necessarily return any samples at all
-		//   during some rounds!
-		// - On the other hand, during some round 'receiveSamples' may have more
-		//   ready samples than would fit into 'sampleBuffer', and for this reason
-		//   the 'receiveSamples' call is iterated for as many times as it
-		//   outputs samples.
-		do {
-			samples_per_channel = pSoundTouch.receiveSamples(sampleBuffer, buffSizeSamples);
-			out->append_samples(sampleBuffer, nChannels * samples_per_channel);
-		} while(samples_per_channel != 0);
+		stretcher.putSamples(samples, samples_per_channel);
+
+		receive_samples();
 	}
 
 	// Even though the input file has been processed, we still have to 'flush' the few last
 	// samples that might be hidden in the SoundTouch's internal processing pipeline.
-	pSoundTouch.flush();
-	do {
-		samples_per_channel = pSoundTouch.receiveSamples(sampleBuffer, buffSizeSamples);
-		out->append_samples(sampleBuffer, nChannels * samples_per_channel);
-	} while(samples_per_channel != 0);
+	stretcher.flush();
+	receive_samples();
+	stretcher.clear();
+
+	return true;
+}
+
+namespace {
+
+/**
+ * Convert the given region into a range of frames and compute the range of samples that should be fed to SoundTouch,
+ * together with the number of output frames that should be skipped and kept.
+ *
+ * SoundTouch needs some input before its output settles down. Hence, we start processing a bit before the beginning
+ * of the region and discard the output that corresponds to this pre-roll. For the same reason we keep processing a
+ * bit after the end of the region.
+ */
+struct Region {
+	Region(const SampleSource &source, float tempo_change, qint64 start_us, qint64 end_us) {
+		channels = source.channels();
+		int rate = source.sample_rate();
+		tempo_ratio = (tempo_change + 100.) / 100.;
+		n_frames = source.n_frames();
+		preroll_frames = SoundUtils::PREROLL_US * rate / 1000000;
+
+		start_frame = qBound((qint64) 0, start_us * rate / 1000000, n_frames);
+		end_frame = (end_us < 0) ? n_frames : qBound(start_frame, end_us * rate / 1000000, n_frames);
+		n_out_frames = qRound64((end_frame - start_frame) / tempo_ratio);
+	}
+
+	/// The position in the output of the given input frame.
+	qint64 out_frame(qint64 frame) const {
+		return qRound64((frame - start_frame) / tempo_ratio);
+	}
+
+	/// Samples that should be fed to SoundTouch to obtain the output corresponding to the [from_frame, to_frame) input frames.
+	void input_range(qint64 from_frame, qint64 to_frame, qint64 &first_sample, qint64 &last_sample, qint64 &frames_to_skip) const {
+		qint64 first_frame = std::max((qint64) 0, from_frame - preroll_frames);
+		first_sample = first_frame * channels;
+		last_sample = std::min(n_frames, to_frame + preroll_frames) * channels;
+		frames_to_skip = qRound64((from_frame - first_frame) / tempo_ratio);
+	}
+
+	int channels;
+	qreal tempo_ratio;
+	qint64 n_frames, preroll_frames;
+	qint64 start_frame, end_frame, n_out_frames;
+};
+
+/// Processes a single segment for SoundUtils::process_parallel().
+class SegmentJob: public QRunnable {
+public:
+	SegmentJob(const SampleSource &source, float tempo_change, int pitch_change, qint64 first_sample, qint64 last_sample, qint64 frames_to_skip, qint64 frames_to_keep, std::vector<float> &out, std::atomic<qint64> &samples_done, std::atomic<bool> &cancelled) :
+					_source(source),
+					_tempo_change(tempo_change),
+					_pitch_change(pitch_change),
+					_first_sample(first_sample),
+					_last_sample(last_sample),
+					_frames_to_skip(frames_to_skip),
+					_frames_to_keep(frames_to_keep),
+					_out(out),
+					_samples_done(samples_done),
+					_cancelled(cancelled) {
+		setAutoDelete(true);
+	}
+
+	virtual void run() {
+		if(_cancelled) return;
+
+		QJsonObject args;
+		args["first_sample"] = _first_sample;
+		args["last_sample"] = _last_sample;
+		TraceSpan span("process", "segment", args);
+
+		ProcessorPool::Lease stretcher = ProcessorPool::shared().acquire(_source.sample_rate(), _source.channels(), _tempo_change, _pitch_change);
+
+		_out.reserve(_frames_to_keep * _source.channels());
+		auto sink = [this](const float *samples, int n_samples) {
+			_out.insert(_out.end(), samples, samples + n_samples);
+		};
+		qint64 last_done = 0;
+		auto callback = [this, &last_done](qint64 done) {
+			_samples_done += done - last_done;
+			last_done = done;
+			return !_cancelled;
+		};
+
+		SoundUtils::stretch(_source, *stretcher, _first_sample, _last_sample, _frames_to_skip, _frames_to_keep, sink, callback);
+		_samples_done += (_last_sample - _first_sample) - last_done;
+	}
+
+private:
+	const SampleSource &_source;
+	float _tempo_change;
+	int _pitch_change;
+	qint64 _first_sample, _last_sample;
+	qint64 _frames_to_skip, _frames_to_keep;
+	std::vector<float> &_out;
+	std::atomic<qint64> &_samples_done;
+	std::atomic<bool> &_cancelled;
+};
+
+} /* namespace */
+
+std::unique_ptr<Wave> SoundUtils::process(const SampleSource &source, float tempo_change, int pitch_change, qint64 start_us, qint64 end_us, const ProgressCallback &progress_callback) {
+	TraceSpan span("process", "process");
+	int nChannels = source.channels();
+	ProcessorPool::Lease stretcher = ProcessorPool::shared().acquire(source.sample_rate(), nChannels, tempo_change, pitch_change);
+
+	Region region(source, tempo_change, start_us, end_us);
+	qint64 first_sample, last_sample, frames_to_skip;
+	region.input_range(region.start_frame, region.end_frame, first_sample, last_sample, frames_to_skip);
+
+	std::unique_ptr<Wave> out(new Wave(nChannels, source.sample_rate(), OUTPUT_BITS_PER_SAMPLE));
+	// the length of the output is known in advance, so that collecting it does not require any reallocation
+	out->reserve_samples(region.n_out_frames * nChannels);
+	auto sink = [&out](const float *samples, int n_samples) {
+		out->append_samples(samples, n_samples);
+	};
+	std::function<bool(qint64)> callback;
+	if(progress_callback) {
+		qint64 n_samples = last_sample - first_sample;
+		callback = [&progress_callback, n_samples](qint64 done) {
+			return progress_callback(done / (qreal) n_samples);
+		};
+	}
+
+	if(!stretch(source, *stretcher, first_sample, last_sample, frames_to_skip, region.n_out_frames, sink, callback)) return nullptr;
+
+	if(progress_callback) progress_callback(1.);
+
+	return out;
+}
+
+std::unique_ptr<Wave> SoundUtils::process_parallel(const SampleSource &source, float tempo_change, int pitch_change, qint64 start_us, qint64 end_us, int n_threads, const ProgressCallback &progress_callback) {
+	int nChannels = source.channels();
+	int rate = source.sample_rate();
+	if(n_threads <= 0) n_threads = QThread::idealThreadCount();
+
+	Region region(source, tempo_change, start_us, end_us);
+	// we use more segments than threads so that the load is balanced even if some segments take longer than others
+	qint64 min_segment_frames = MIN_SEGMENT_US * rate / 1000000;
+	qint64 n_segments = std::min((qint64) n_threads * 4, (region.end_frame - region.start_frame) / min_segment_frames);
+	if(n_threads < 2 || n_segments < 2) return process(source, tempo_change, pitch_change, start_us, end_us, progress_callback);
+
+	qint64 crossfade_frames = CROSSFADE_US * rate / 1000000;
+	qint64 segment_frames = (region.end_frame - region.start_frame + n_segments - 1) / n_segments;
+
+	// each segment's output starts at out_starts[i] and contains the crossfade with the following segment
+	std::vector<std::vector<float>> outputs(n_segments);
+	std::vector<qint64> out_starts(n_segments + 1);
+	std::atomic<qint64> samples_done(0);
+	std::atomic<bool> cancelled(false);
+	qint64 n_samples = 0;
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(n_threads);
+	for(qint64 i = 0; i < n_segments; i++) {
+		qint64 from_frame = region.start_frame + i * segment_frames;
+		qint64 to_frame = std::min(region.end_frame, from_frame + segment_frames);
+		out_starts[i] = region.out_frame(from_frame);
+		out_starts[i + 1] = region.out_frame(to_frame);
+
+		bool is_last = (i == n_segments - 1);
+		// all the segments but the last one have to go beyond their end to provide the samples for the crossfade
+		qint64 to_frame_with_tail = is_last ? to_frame : std::min(region.n_frames, to_frame + (qint64) ceil(crossfade_frames * region.tempo_ratio));
+		qint64 frames_to_keep = out_starts[i + 1] - out_starts[i] + (is_last ? 0 : crossfade_frames);
+
+		qint64 first_sample, last_sample, frames_to_skip;
+		region.input_range(from_frame, to_frame_with_tail, first_sample, last_sample, frames_to_skip);
+		n_samples += last_sample - first_sample;
+
+		pool.start(new SegmentJob(source, tempo_change, pitch_change, first_sample, last_sample, frames_to_skip, frames_to_keep, outputs[i], samples_done, cancelled));
+	}
+
+	while(!pool.waitForDone(100)) {
+		if(progress_callback && !progress_callback(samples_done / (qreal) n_samples)) cancelled = true;
+	}
+	if(cancelled) return nullptr;
+
+	// stitch the segments together, crossfading the overlapping parts
+	std::unique_ptr<Wave> out(new Wave(nChannels, rate, OUTPUT_BITS_PER_SAMPLE));
+	out->reserve_samples(region.n_out_frames * nChannels);
+	std::vector<float> crossfade(crossfade_frames * nChannels);
+	for(qint64 i = 0; i < n_segments; i++) {
+		const std::vector<float> &curr = outputs[i];
+		qint64 curr_frames = curr.size() / nChannels;
+		// the first crossfade_frames frames of all the segments but the first one have been already used
+		qint64 first_frame = (i == 0) ? 0 : std::min(crossfade_frames, curr_frames);
+		qint64 last_frame = std::min(out_starts[i + 1] - out_starts[i], curr_frames);
+		if(last_frame > first_frame) out->append_samples(curr.data() + first_frame * nChannels, (last_frame - first_frame) * nChannels);
+
+		if(i < n_segments - 1) {
+			const std::vector<float> &next = outputs[i + 1];
+			qint64 next_frames = next.size() / nChannels;
+			for(qint64 f = 0; f < crossfade_frames; f++) {
+				float weight = (f + 0.5f) / crossfade_frames;
+				qint64 curr_frame = last_frame + f;
+				for(int c = 0; c < nChannels; c++) {
+					float curr_value = (curr_frame < curr_frames) ? curr[curr_frame * nChannels + c] : 0.f;
+					float next_value = (f < next_frames) ? next[f * nChannels + c] : 0.f;
+					crossfade[f * nChannels + c] = (1.f - weight) * curr_value + weight * next_value;
+				}
+			}
+			out->append_samples(crossfade.data(), crossfade.size());
+		}
+	}
+
+	if(progress_callback) progress_callback(1.);
 
 	return out;
 }
 
+SoundUtils::WaveformData SoundUtils::waveform_data(const Wave &wave) {
+	qint64 n_samples = wave.get_n_samples();
+	int n_channels = wave.get_channels();
+	// whatever their format, samples are converted to floats in [-1, 1), and each channel is plotted above the
+	// previous one
+	const qreal channel_height = 2.;
+
+	qint64 n_samples_per_channel = n_samples / n_channels;
+	WaveformData result;
+	result.x.resize(n_samples_per_channel);
+	for(qint64 idx = 0; idx < n_samples_per_channel; idx++) {
+		result.x[idx] = idx / (qreal) wave.get_samples_per_sec();
+	}
+
+	result.y.resize(n_channels);
+	for(auto &y_data : result.y) y_data.resize(n_samples_per_channel);
+
+	// the samples are converted block by block, which does not require a copy of the whole wave
+	const qint64 block_frames = 4096;
+	std::vector<float> block(block_frames * n_channels);
+	for(qint64 frame = 0; frame < n_samples_per_channel; frame += block_frames) {
+		qint64 n_frames = std::min(block_frames, n_samples_per_channel - frame);
+		wave.get_samples(frame * n_channels, n_frames * n_channels, block.data());
+		for(int channel = 0; channel < n_channels; channel++) {
+			qreal *y_data = result.y[channel].data() + frame;
+			const float *sample = block.data() + channel;
+			// shift each plot up
+			qreal shift = channel * channel_height;
+			for(qint64 i = 0; i < n_frames; i++, sample += n_channels) {
+				y_data[i] = *sample + shift;
+			}
+		}
+	}
+
+	result.y_min = -1.;
+	result.y_max = -1. + channel_height * n_channels;
+
+	return result;
+}
+
+SoundUtils::WaveformData SoundUtils::waveform_data(const SampleSource &source, qint64 max_points) {
+	qint64 n_frames = source.n_frames();
+	int n_channels = source.channels();
+	const qreal channel_height = 2.;
+
+	WaveformData result;
+	result.y.resize(n_channels);
+	result.y_min = -1.;
+	result.y_max = -1. + channel_height * n_channels;
+	if(n_frames == 0) return result;
+
+	// each interval is plotted as its minimum followed by its maximum
+	qint64 n_intervals = qBound((qint64) 1, max_points / 2, n_frames);
+	qint64 interval_frames = (n_frames + n_intervals - 1) / n_intervals;
+	n_intervals = (n_frames + interval_frames - 1) / interval_frames;
+	result.x.resize(2 * n_intervals);
+	for(auto &y_data : result.y) y_data.resize(2 * n_intervals);
+
+	const qint64 block_frames = 4096;
+	std::vector<float> block(block_frames * n_channels);
+	std::vector<float> minimum(n_channels), maximum(n_channels);
+	for(qint64 interval = 0; interval < n_intervals; interval++) {
+		qint64 first_frame = interval * interval_frames;
+		qint64 end_frame = std::min(n_frames, first_frame + interval_frames);
+		// the curves always go through 0, which is where silence is plotted
+		std::fill(minimum.begin(), minimum.end(), 0.f);
+		std::fill(maximum.begin(), maximum.end(), 0.f);
+
+		for(qint64 frame = first_frame; frame < end_frame; frame += block_frames) {
+			qint64 n_read = source.read(frame * n_channels, std::min(block_frames, end_frame - frame) * n_channels, block.data());
+			for(qint64 i = 0; i < n_read; i++) {
+				int channel = i % n_channels;
+				minimum[channel] = std::min(minimum[channel], block[i]);
+				maximum[channel] = std::max(maximum[channel], block[i]);
+			}
+		}
+
+		result.x[2 * interval] = first_frame / (qreal) source.sample_rate();
+		result.x[2 * interval + 1] = (first_frame + end_frame) / 2. / source.sample_rate();
+		for(int channel = 0; channel < n_channels; channel++) {
+			// shift each plot up
+			qreal shift = channel * channel_height;
+			result.y[channel][2 * interval] = minimum[channel] + shift;
+			result.y[channel][2 * interval + 1] = maximum[channel] + shift;
+		}
+	}
+
+	return result;
+}
+
 } /* namespace cb */
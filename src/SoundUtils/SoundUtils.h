@@ -9,9 +9,12 @@
 #define SRC_SOUNDUTILS_SOUNDUTILS_H_
 
 #include <memory>
+#include <functional>
+#include <vector>
 
 #include <QDebug>
 #include <QBuffer>
+#include <QVector>
 
 #include <soundtouch/SoundTouch.h>
 
@@ -22,32 +25,112 @@ class WavInFile;
 namespace cb {
 
 class Wave;
+class SampleSource;
 using namespace soundtouch;
 
+/**
+ * Callback used to report the progress of a long operation. It receives the fraction of the work done so far
+ * (between 0 and 1) and returns false if the operation should be aborted.
+ */
+using ProgressCallback = std::function<bool(qreal)>;
+
+/**
+ * Stateless audio-processing facilities. SoundTouch processors are taken from ProcessorPool::shared(), so that any
+ * number of threads can process audio at the same time.
+ */
 class SoundUtils {
 public:
-	static SoundUtils* Instance() {
-		static SoundUtils* m_pInstance;
-		if(!m_pInstance)
-			m_pInstance = new SoundUtils;
-		assert(m_pInstance != NULL);
-		return m_pInstance;
-	}
-
 	static qint64 audio_length(QAudioFormat &format, qint64 microseconds);
 	static qreal pcmToReal(QAudioFormat &format, int pcm);
 
-	std::unique_ptr<Wave> process(Wave &in_file, float tempo_change, int pitch_change);
+	/**
+	 * Process (a region of) source, changing its tempo and pitch.
+	 *
+	 * @param source
+	 * @param tempo_change Change in tempo (in percentage)
+	 * @param pitch_change Change in pitch (in number of semitones)
+	 * @param start_us Beginning of the region to be processed (in microseconds)
+	 * @param end_us End of the region to be processed (in microseconds). Pass a negative value to process up to the end of source
+	 * @param progress_callback If set, it is called periodically. If it returns false the processing is aborted
+	 * @return The processed region, or nullptr if the processing has been aborted
+	 */
+	static std::unique_ptr<Wave> process(const SampleSource &source, float tempo_change, int pitch_change, qint64 start_us = 0, qint64 end_us = -1, const ProgressCallback &progress_callback = nullptr);
+
+	/**
+	 * Process (a region of) source, changing its tempo and pitch, using several threads.
+	 *
+	 * The region is split into overlapping segments that are processed independently by separate SoundTouch
+	 * instances. The seams between consecutive segments are then crossfaded. Regions that are too short to be
+	 * split are processed serially by process().
+	 *
+	 * @param source
+	 * @param tempo_change Change in tempo (in percentage)
+	 * @param pitch_change Change in pitch (in number of semitones)
+	 * @param start_us Beginning of the region to be processed (in microseconds)
+	 * @param end_us End of the region to be processed (in microseconds). Pass a negative value to process up to the end of source
+	 * @param n_threads Number of threads to use. Pass a non-positive number to use as many threads as there are cores
+	 * @param progress_callback If set, it is called periodically. If it returns false the processing is aborted
+	 * @return The processed region, or nullptr if the processing has been aborted
+	 */
+	static std::unique_ptr<Wave> process_parallel(const SampleSource &source, float tempo_change, int pitch_change, qint64 start_us = 0, qint64 end_us = -1, int n_threads = 0, const ProgressCallback &progress_callback = nullptr);
+
+	/// Length (in microseconds) of the audio processed before and after a region to let SoundTouch settle.
+	static const qint64 PREROLL_US = 250000;
+	/// Minimum length (in microseconds) of the segments processed in parallel by process_parallel().
+	static const qint64 MIN_SEGMENT_US = 5000000;
+	/// Length (in microseconds) of the crossfade between consecutive segments processed by process_parallel().
+	static const qint64 CROSSFADE_US = 20000;
+	/// Sample size of the waves produced by process() and process_parallel(), which go to the audio device.
+	static const int OUTPUT_BITS_PER_SAMPLE = 16;
+
+	/// Receives n_samples processed samples.
+	using SampleSink = std::function<void(const float *samples, int n_samples)>;
+
+	/**
+	 * Feed samples in [first_sample, last_sample) to the given SoundTouch instance and pass the output to sink, after
+	 * having discarded its first frames_to_skip frames. At most frames_to_keep frames are passed to the sink.
+	 *
+	 * @param source
+	 * @param stretcher An already configured SoundTouch instance
+	 * @param first_sample
+	 * @param last_sample
+	 * @param frames_to_skip
+	 * @param frames_to_keep
+	 * @param sink
+	 * @param progress_callback If set, it is called periodically with the number of samples fed so far. If it returns false the processing is aborted
+	 * @return false if the processing has been aborted, true otherwise
+	 */
+	static bool stretch(const SampleSource &source, soundtouch::SoundTouch &stretcher, qint64 first_sample, qint64 last_sample, qint64 frames_to_skip, qint64 frames_to_keep, const SampleSink &sink, const std::function<bool(qint64)> &progress_callback = nullptr);
+
+	/// What is needed to plot a wave, one curve per channel.
+	struct WaveformData {
+		/// Time (in seconds) of each point. It is shared by all the channels.
+		QVector<qreal> x;
+		/// Values of the points, one vector per channel. Each channel is shifted upwards, so that the curves do not overlap.
+		std::vector<QVector<qreal>> y;
+		/// Vertical range spanned by the curves.
+		qreal y_min, y_max;
+	};
+
+	/**
+	 * Prepare the data required to plot the given wave.
+	 *
+	 * @param wave
+	 * @return
+	 */
+	static WaveformData waveform_data(const Wave &wave);
+	/**
+	 * Prepare the data required to plot an overview of the given source, which does not need to be kept in memory.
+	 * The samples are read in blocks and, for each interval, only their minimum and maximum are plotted.
+	 *
+	 * @param source
+	 * @param max_points Maximum number of points per channel
+	 * @return
+	 */
+	static WaveformData waveform_data(const SampleSource &source, qint64 max_points);
 
 private:
-	soundtouch::SoundTouch pSoundTouch;
-
-	SoundUtils();
-
-	SoundUtils(SoundUtils const&) = delete;
-	SoundUtils& operator=(SoundUtils const&) = delete;
-
-	virtual ~SoundUtils();
+	SoundUtils() = delete;
 };
 
 } /* namespace cb */
@@ -0,0 +1,585 @@
+/*
+ * StretchDevice.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "StretchDevice.h"
+
+#include "Wave.h"
+#include "SampleSource.h"
+#include "SampleConversion.h"
+#include "../Tracer.h"
+
+#include <QThread>
+#include <QMutexLocker>
+
+#include <cstring>
+#include <stdexcept>
+
+namespace cb {
+
+/// Number of samples (all channels included) fed to SoundTouch at each step.
+#define BLOCK_SAMPLES 4096
+/// How often (in milliseconds) the feeder checks the fill level of the buffer while it is idle.
+#define FEED_INTERVAL_MS 5
+/// Loops shorter than this (in microseconds of the original stream) are not looped.
+#define MIN_LOOP_US 10000
+
+class StretchDevice::Feeder: public QThread {
+public:
+	Feeder(StretchDevice *device) :
+					_device(device) {
+		setObjectName("feeder");
+
+	}
+
+protected:
+	virtual void run() {
+		_device->_feed();
+	}
+
+private:
+	StretchDevice *_device;
+};
+
+StretchDevice::StretchDevice(QObject *parent) :
+				QIODevice(parent),
+				_feeder(new Feeder(this)),
+				_quit(false),
+				_producing(false),
+				_requested_generation(0),
+				_restart_us(0),
+				_restart_written_bytes(0),
+				_generation(0),
+				_discard_position(0),
+				_refilling(true),
+				_source(nullptr),
+				_rendition_byte(0),
+				_channels(1),
+				_sample_rate(44100),
+				_source_sample(0),
+				_source_finished(true),
+				_segment_start_us(0),
+				_segment_bytes(0),
+				_written_bytes(0),
+				_feeding_finished(true),
+				_low_watermark_us(DEFAULT_LOW_WATERMARK_US),
+				_high_watermark_us(DEFAULT_HIGH_WATERMARK_US),
+				_low_watermark(0),
+				_high_watermark(0),
+				_output_bytes(0),
+				_silent_bytes(0),
+				_underruns(0) {
+	_settings.tempo_change = 0.;
+	_settings.pitch_change = 0;
+	_settings.start_us = 0;
+	_settings.end_us = -1;
+	_settings.looping = false;
+	_settings.crossfade_us = 0;
+	_active = _settings;
+
+	_in_buffer.resize(BLOCK_SAMPLES);
+	_out_buffer.resize(BLOCK_SAMPLES);
+	// with a reserved capacity, emptying the pending samples with resize(0) keeps their memory, so that the feeder
+	// does not allocate anything in the steady state
+	_pending.reserve(4 * BLOCK_SAMPLES * sizeof(short));
+	_resize_ring();
+
+	_feeder->start();
+}
+
+StretchDevice::~StretchDevice() {
+	{
+		QMutexLocker locker(&_mutex);
+		_quit = true;
+		_wake.wakeAll();
+	}
+	_feeder->wait();
+}
+
+void StretchDevice::set_source(const SampleSource *source) {
+	QMutexLocker locker(&_mutex);
+	// the feeder must be done with the old source
+	while(_producing) _idle.wait(&_mutex);
+
+	_source = source;
+	// renditions of the previous source are of no use
+	_settings.next_rendition = Rendition();
+	_active.next_rendition = Rendition();
+	_rendition = Rendition();
+
+	if(source == nullptr) {
+		_stretcher = ProcessorPool::Lease();
+		_ring.clear();
+		_pending.resize(0);
+		_feeding_finished = true;
+		// there is nothing left to restart
+		_generation = _requested_generation.load();
+		return;
+	}
+
+	_channels = source->channels();
+	_sample_rate = source->sample_rate();
+	_stretcher = ProcessorPool::shared().acquire(_sample_rate, _channels, _settings.tempo_change, _settings.pitch_change);
+	_resize_ring();
+
+	_seek(0);
+}
+
+void StretchDevice::set_parameters(qreal tempo_change, int pitch_change) {
+	QMutexLocker locker(&_mutex);
+	if(tempo_change == _settings.tempo_change && pitch_change == _settings.pitch_change) return;
+
+	// the feeder applies them to SoundTouch when it restarts
+	_settings.tempo_change = tempo_change;
+	_settings.pitch_change = pitch_change;
+	if(_source == nullptr) return;
+
+	// the buffered samples have been stretched with the old values, so we start over from the read position
+	qint64 anchor_us = _output_us(_output_bytes);
+	qint64 original_us = _original_us_at(anchor_us + _output_us(_silent_bytes));
+	// loop passes that have been buffered but not played yet are dropped together with the buffer
+	while(_anchors.size() > 1 && _anchors.back().output_us > anchor_us) _anchors.pop_back();
+	_anchors.push_back(Anchor { anchor_us, original_us, tempo_change });
+
+	_request_restart(original_us, _output_bytes);
+}
+
+void StretchDevice::set_rendition(const Rendition &rendition) {
+	QMutexLocker locker(&_mutex);
+	_settings.next_rendition = rendition;
+}
+
+void StretchDevice::seek_us(qint64 original_us) {
+	QJsonObject args;
+	args["position_us"] = original_us;
+	TraceSpan span("playback", "seek", args);
+
+	QMutexLocker locker(&_mutex);
+	if(_source == nullptr) return;
+
+	_seek(original_us);
+}
+
+void StretchDevice::_seek(qint64 original_us) {
+	_output_bytes = 0;
+	_silent_bytes = 0;
+	_underruns = 0;
+	_anchors.clear();
+	_anchors.push_back(Anchor { 0, original_us, _settings.tempo_change });
+
+	_request_restart(original_us, 0);
+}
+
+void StretchDevice::set_boundaries(qint64 start_us, qint64 end_us) {
+	QMutexLocker locker(&_mutex);
+	_settings.start_us = qMax((qint64) 0, start_us);
+	_settings.end_us = end_us;
+}
+
+void StretchDevice::set_looping(bool enabled, qint64 crossfade_us) {
+	QMutexLocker locker(&_mutex);
+	_settings.looping = enabled;
+	_settings.crossfade_us = qMax((qint64) 0, crossfade_us);
+
+	// the feeder might have already stopped at the end boundary
+	if(enabled) _wake.wakeAll();
+}
+
+qint64 StretchDevice::original_us_at(qint64 output_us) const {
+	QMutexLocker locker(&_mutex);
+	if(_anchors.empty()) return 0;
+
+	// the playing time only moves forward, hence the anchors that precede the current one are not needed anymore
+	qint64 content_us = output_us - _output_us(_silent_bytes);
+	auto anchor = _anchors.begin();
+	while(anchor + 1 != _anchors.end() && (anchor + 1)->output_us <= content_us) anchor++;
+	_anchors.erase(_anchors.begin(), anchor);
+
+	return _original_us_at(output_us);
+}
+
+qint64 StretchDevice::_original_us_at(qint64 output_us) const {
+	if(_anchors.empty()) return 0;
+
+	// the silence played during underruns does not move the read position
+	output_us -= _output_us(_silent_bytes);
+
+	auto anchor = _anchors.begin();
+	while(anchor + 1 != _anchors.end() && (anchor + 1)->output_us <= output_us) anchor++;
+
+	qreal factor = (anchor->tempo_change + 100.) / 100.;
+	return anchor->original_us + (output_us - anchor->output_us) * factor;
+}
+
+void StretchDevice::set_watermarks(qint64 low_us, qint64 high_us) {
+	if(low_us < 0 || high_us < low_us) throw std::runtime_error("Invalid buffer watermarks");
+
+	QMutexLocker locker(&_mutex);
+	// the feeder must not be writing to the buffer while it is resized
+	while(_producing) _idle.wait(&_mutex);
+	_low_watermark_us = low_us;
+	_high_watermark_us = high_us;
+	_resize_ring();
+
+	// resizing drops the content of the buffer
+	if(_source != nullptr) {
+		qint64 anchor_us = _output_us(_output_bytes);
+		qint64 original_us = _original_us_at(anchor_us + _output_us(_silent_bytes));
+		while(_anchors.size() > 1 && _anchors.back().output_us > anchor_us) _anchors.pop_back();
+		_anchors.push_back(Anchor { anchor_us, original_us, _settings.tempo_change });
+
+		_request_restart(original_us, _output_bytes);
+	}
+}
+
+qint64 StretchDevice::low_watermark_us() const {
+	return _low_watermark_us;
+}
+
+qint64 StretchDevice::high_watermark_us() const {
+	return _high_watermark_us;
+}
+
+qint64 StretchDevice::buffered_us() const {
+	return _output_us(_buffered_bytes());
+}
+
+int StretchDevice::underrun_count() const {
+	return _underruns;
+}
+
+bool StretchDevice::isSequential() const {
+	return true;
+}
+
+bool StretchDevice::atEnd() const {
+	// until the feeder restarts, there is more to come
+	if(_generation != _requested_generation) return false;
+	return _feeding_finished && _buffered_bytes() == 0;
+}
+
+qint64 StretchDevice::bytesAvailable() const {
+	return _buffered_bytes() + QIODevice::bytesAvailable();
+}
+
+qint64 StretchDevice::readData(char *data, qint64 maxlen) {
+	if(_source == nullptr) return -1;
+
+	// the feeder only ever appends whole frames
+	qint64 frame_size = _channels * sizeof(short);
+	qint64 n_wanted = maxlen - maxlen % frame_size;
+
+	if(_generation.load() != _requested_generation.load()) {
+		// the feeder has not restarted yet: whatever is buffered is stale, and silence is played in its place
+		_ring.discard(_ring.write_position());
+		memset(data, 0, n_wanted);
+		_silent_bytes += n_wanted;
+		return n_wanted;
+	}
+	_ring.discard(_discard_position);
+
+	// the flag must be read first: if it is set, whatever has been produced is already in the buffer
+	bool finished = _feeding_finished;
+	qint64 n_bytes = _ring.read(data, n_wanted);
+	_output_bytes += n_bytes;
+
+	if(n_bytes < n_wanted && !finished) {
+		// returning less data than requested would make the audio output go idle
+		memset(data + n_bytes, 0, n_wanted - n_bytes);
+		_silent_bytes += n_wanted - n_bytes;
+		_underruns++;
+		n_bytes = n_wanted;
+	}
+
+	return n_bytes;
+}
+
+qint64 StretchDevice::writeData(const char *data, qint64 len) {
+	Q_UNUSED(data);
+	Q_UNUSED(len);
+	return -1;
+}
+
+void StretchDevice::_feed() {
+	QMutexLocker locker(&_mutex);
+	while(!_quit) {
+		if(_source != nullptr && _generation != _requested_generation) _restart();
+		else {
+			// looping might have been enabled after the feeder stopped at the end boundary
+			if(_source != nullptr && _settings.looping && !_active.looping) _feeding_finished = false;
+			// tempo and pitch changes always come with a restart
+			_active = _settings;
+		}
+
+		qint64 fill_level = _buffered_bytes();
+		if(fill_level < _low_watermark) _refilling = true;
+		else if(fill_level >= _high_watermark) _refilling = false;
+
+		if(_source == nullptr || _feeding_finished || !_refilling) {
+			_wake.wait(&_mutex, FEED_INTERVAL_MS);
+		}
+		else {
+			// reading the source (which might mean decoding it) and running SoundTouch take a while, during which the
+			// other threads must be free to change the state of the device
+			_producing = true;
+			locker.unlock();
+			{
+				TraceSpan span("playback", "feed");
+				_produce();
+			}
+			locker.relock();
+			_producing = false;
+			_idle.wakeAll();
+		}
+	}
+}
+
+void StretchDevice::_produce() {
+	if(_pending.isEmpty()) _fill_pending();
+
+	bool looping = _active.looping && (_end_boundary() - _active.start_us) >= MIN_LOOP_US;
+	// when looping, the last few bytes before the end boundary are set aside for the crossfade
+	qint64 until_end = _bytes_until(_end_boundary()) - (looping ? _crossfade_bytes() : 0);
+
+	int frame_size = _channels * sizeof(short);
+	qint64 n_bytes = qMin((qint64) _pending.size(), _ring.free_space());
+	n_bytes = qMin(n_bytes, qMax(until_end, (qint64) 0));
+	n_bytes -= n_bytes % frame_size;
+	if(n_bytes > 0) {
+		_ring.write(_pending.constData(), n_bytes);
+		_pending.remove(0, n_bytes);
+		_segment_bytes += n_bytes;
+		_written_bytes += n_bytes;
+	}
+
+	bool source_over = _source_finished && !_rendition.is_valid() && _pending.isEmpty();
+	if(until_end - n_bytes < frame_size || source_over) {
+		if(looping) _wrap();
+		else {
+			_pending.resize(0);
+			_feeding_finished = true;
+		}
+	}
+}
+
+void StretchDevice::_fill_pending() {
+	if(_rendition.is_valid()) {
+		const Wave *wave = _rendition.wave.get();
+		int frame_size = _channels * wave->get_bytes_per_sample();
+		qint64 remaining = wave->get_data_size() - _rendition_byte;
+
+		if(remaining >= frame_size) {
+			qint64 n_bytes = qMin(remaining, (qint64) (BLOCK_SAMPLES * sizeof(short)));
+			n_bytes -= n_bytes % frame_size;
+			_pending.append(wave->data() + _rendition_byte, n_bytes);
+			_rendition_byte += n_bytes;
+			return;
+		}
+
+		// if the rendition is over but the source is not, we go on processing the source on the fly
+		qint64 end_us = _rendition.end_us;
+		_rendition = Rendition();
+		if(end_us >= _source->duration_us()) {
+			_source_finished = true;
+			return;
+		}
+		_seek_source(end_us);
+		_segment_start_us = end_us;
+		_segment_bytes = 0;
+	}
+
+	if(!_source_finished) _process_block();
+}
+
+void StretchDevice::_wrap() {
+	int frame_size = _channels * sizeof(short);
+	qint64 crossfade_bytes = _crossfade_bytes();
+	// the whole crossfade must be appended in one go
+	if(_ring.free_space() < crossfade_bytes) return;
+
+	// the tail of the loop, which fades out
+	qint64 tail_bytes = qBound((qint64) 0, _bytes_until(_end_boundary()), crossfade_bytes);
+	while(_pending.size() < tail_bytes && !(_source_finished && !_rendition.is_valid())) {
+		_fill_pending();
+	}
+	tail_bytes = qMin(tail_bytes, (qint64) _pending.size());
+	tail_bytes -= tail_bytes % frame_size;
+	QByteArray tail = _pending.left(tail_bytes);
+
+	// the audio that precedes the beginning of the loop, which fades in so that the loop starts at full volume
+	qreal factor = (_active.tempo_change + 100.) / 100.;
+	qint64 head_start_us = qMax((qint64) 0, _active.start_us - (qint64) (_output_us(tail_bytes) * factor));
+	_reposition(head_start_us);
+	qint64 head_bytes = qBound((qint64) 0, _bytes_until(_active.start_us), tail_bytes);
+	while(_pending.size() < head_bytes && !(_source_finished && !_rendition.is_valid())) {
+		_fill_pending();
+	}
+	head_bytes = qMin(head_bytes, (qint64) _pending.size());
+	head_bytes -= head_bytes % frame_size;
+	QByteArray head = _pending.left(head_bytes);
+	_pending.remove(0, head_bytes);
+	_segment_bytes += head_bytes;
+
+	if(tail_bytes > 0) {
+		// the head is aligned to the end of the tail: if there is not enough audio before the beginning of the loop,
+		// the tail fades out into silence
+		short *tail_s = reinterpret_cast<short *>(tail.data());
+		const short *head_s = reinterpret_cast<const short *>(head.constData());
+		qint64 n_frames = tail_bytes / frame_size;
+		qint64 head_offset = n_frames - head_bytes / frame_size;
+		for(qint64 frame = 0; frame < n_frames; frame++) {
+			float weight = (frame + 1) / (float) (n_frames + 1);
+			for(int c = 0; c < _channels; c++) {
+				qint64 i = frame * _channels + c;
+				float head_value = (frame >= head_offset) ? head_s[i - head_offset * _channels] : 0.f;
+				tail_s[i] = (short) (tail_s[i] * (1.f - weight) + head_value * weight);
+			}
+		}
+		_ring.write(tail.constData(), tail_bytes);
+		_written_bytes += tail_bytes;
+	}
+
+	QMutexLocker locker(&_mutex);
+	// the loop passes produced before a restart are dropped together with their audio
+	if(_generation == _requested_generation) _anchors.push_back(Anchor { _output_us(_written_bytes), _active.start_us, _active.tempo_change });
+}
+
+void StretchDevice::_reposition(qint64 original_us) {
+	const Rendition &next = _active.next_rendition;
+	bool rendition_usable = next.tempo_change == _active.tempo_change && next.pitch_change == _active.pitch_change;
+	if(rendition_usable && next.covers(original_us, original_us) && original_us < next.end_us) {
+		_rendition = next;
+		_rendition_byte = _rendition.byte_offset(original_us);
+		_source_finished = false;
+		_pending.resize(0);
+	}
+	else {
+		_rendition = Rendition();
+		_seek_source(original_us);
+	}
+
+	_segment_start_us = original_us;
+	_segment_bytes = 0;
+}
+
+void StretchDevice::_request_restart(qint64 original_us, qint64 written_bytes) {
+	_restart_us = original_us;
+	_restart_written_bytes = written_bytes;
+	// the audio that is left in the buffer is stale, and readData() drops it until the feeder restarts
+	_requested_generation++;
+	_wake.wakeAll();
+}
+
+void StretchDevice::_restart() {
+	_active = _settings;
+	if(_stretcher.is_valid()) {
+		_stretcher->setTempoChange(_active.tempo_change);
+		_stretcher->setPitchSemiTones(_active.pitch_change);
+	}
+	_written_bytes = _restart_written_bytes;
+	_reposition(_restart_us);
+
+	// what has been written so far belongs to the previous position, and it must be dropped before the reader is
+	// told that the restart took place
+	_discard_position = _ring.write_position();
+	_feeding_finished = false;
+	_refilling = true;
+	_generation = _requested_generation.load();
+}
+
+qint64 StretchDevice::_buffered_bytes() const {
+	if(_generation.load() != _requested_generation.load()) return 0;
+
+	// the reader drops the bytes that precede the discard position. The write position must be read last, since the
+	// reader might move the read position past any earlier value of it
+	qint64 first = qMax(_ring.read_position(), _discard_position.load());
+	return _ring.write_position() - first;
+}
+
+qint64 StretchDevice::_bytes_until(qint64 original_us) const {
+	qreal factor = (_active.tempo_change + 100.) / 100.;
+	qint64 output_us = (original_us - _segment_start_us) / factor;
+	return _output_bytes_for(output_us) - _segment_bytes;
+}
+
+qint64 StretchDevice::_end_boundary() const {
+	qint64 duration_us = _source->duration_us();
+	return (_active.end_us < 0) ? duration_us : qMin(_active.end_us, duration_us);
+}
+
+qint64 StretchDevice::_crossfade_bytes() const {
+	// the crossfade cannot take more than half of the loop, nor a sizeable part of the buffer
+	qreal factor = (_active.tempo_change + 100.) / 100.;
+	qint64 loop_bytes = _output_bytes_for((_end_boundary() - _active.start_us) / factor);
+	qint64 n_bytes = qMin(_output_bytes_for(_active.crossfade_us), qMin(loop_bytes / 2, _ring.capacity() / 4));
+
+	int frame_size = _channels * sizeof(short);
+	return n_bytes - n_bytes % frame_size;
+}
+
+void StretchDevice::_seek_source(qint64 original_us) {
+	// always start from the beginning of a frame, otherwise channels would get swapped
+	qint64 frame = original_us * _sample_rate / 1000000;
+	_source_sample = qBound((qint64) 0, frame * _channels, _source->n_samples());
+	_source_finished = false;
+
+	_stretcher->clear();
+	_pending.resize(0);
+}
+
+void StretchDevice::_resize_ring() {
+	_low_watermark = _output_bytes_for(_low_watermark_us);
+	_high_watermark = _output_bytes_for(_high_watermark_us);
+	// some room is left above the high watermark, since the feeder works in blocks
+	_ring.reset(2 * _high_watermark + BLOCK_SAMPLES * sizeof(short));
+	_discard_position = 0;
+}
+
+qint64 StretchDevice::_output_us(qint64 n_bytes) const {
+	qint64 frame_size = _channels * sizeof(short);
+	return (n_bytes / frame_size) * 1000000 / _sample_rate;
+}
+
+qint64 StretchDevice::_output_bytes_for(qint64 output_us) const {
+	qint64 frame_size = _channels * sizeof(short);
+	return output_us * _sample_rate / 1000000 * frame_size;
+}
+
+void StretchDevice::_process_block() {
+	qint64 samples_read = qMin((qint64) BLOCK_SAMPLES, _source->n_samples() - _source_sample);
+	const float *samples = _source->samples(_source_sample, samples_read);
+	if(samples == nullptr) {
+		samples_read = _source->read(_source_sample, samples_read, _in_buffer.data());
+		samples = _in_buffer.data();
+	}
+
+	if(samples_read > 0) {
+		_stretcher->putSamples(samples, samples_read / _channels);
+		_source_sample += samples_read;
+	}
+	else {
+		// flush the last few samples that might be hidden in the SoundTouch's internal processing pipeline
+		_stretcher->flush();
+		_source_finished = true;
+	}
+
+	_receive_samples();
+}
+
+void StretchDevice::_receive_samples() {
+	int buff_size_frames = BLOCK_SAMPLES / _channels;
+	int frames_received;
+	do {
+		frames_received = _stretcher->receiveSamples(_out_buffer.data(), buff_size_frames);
+		int n_samples = frames_received * _channels;
+
+		int old_size = _pending.size();
+		_pending.resize(old_size + n_samples * sizeof(short));
+		SampleConversion::to_int16(_out_buffer.data(), reinterpret_cast<int16_t *>(_pending.data() + old_size), n_samples);
+	} while(frames_received != 0);
+}
+
+} /* namespace cb */
@@ -0,0 +1,290 @@
+/*
+ * StretchDevice.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_SOUNDUTILS_STRETCHDEVICE_H_
+#define SRC_SOUNDUTILS_STRETCHDEVICE_H_
+
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "Rendition.h"
+#include "ProcessorPool.h"
+#include "RingBuffer.h"
+
+namespace cb {
+
+class SampleSource;
+
+/**
+ * A read-only, pull-based device that stretches the audio of a SampleSource on the fly, producing 16-bit samples.
+ *
+ * A feeder thread keeps a ring buffer topped up with stretched audio: every time the buffer runs low, the next few
+ * blocks of the source are fed into SoundTouch and whatever comes out is appended to the buffer. Reading from the
+ * device just drains the buffer, without taking locks or allocating memory. The time required to start playing
+ * is thus bounded by the size of a block rather than by the length of the source.
+ *
+ * The feeder does not hold any lock while it reads the source and runs SoundTouch. Seeking or changing tempo and
+ * pitch only asks the feeder to restart from a new position: until it does, the stale audio in the buffer is dropped
+ * and silence is read in its place.
+ *
+ * If an already processed version of (a region of) the source is available, the feeder copies its samples
+ * directly whenever the read position falls within the region.
+ *
+ * Playing stops exactly at the end boundary or, if looping is enabled, wraps around to the start boundary without
+ * any gap, optionally crossfading the end of the loop into the audio that precedes its beginning.
+ *
+ * All the methods but readData() must be called from the thread that reads from the device.
+ */
+class StretchDevice: public QIODevice {
+	Q_OBJECT;
+
+public:
+	/// Default fill level (in microseconds) below which the feeder starts topping the buffer up.
+	static const qint64 DEFAULT_LOW_WATERMARK_US = 50000;
+	/// Default fill level (in microseconds) at which the feeder stops topping the buffer up.
+	static const qint64 DEFAULT_HIGH_WATERMARK_US = 200000;
+
+	StretchDevice(QObject *parent = nullptr);
+	virtual ~StretchDevice();
+
+	/**
+	 * Set the samples that will be stretched. The device does not take ownership of the source. Pass nullptr before
+	 * destroying the source.
+	 *
+	 * @param source
+	 */
+	void set_source(const SampleSource *source);
+
+	/**
+	 * Set the tempo and pitch changes that will be applied to the samples that have not been played yet. This can
+	 * be done while playing: the buffered samples are dropped and the new values take effect within a processing
+	 * block, starting from the current read position. If the rendition set with set_rendition() has been generated
+	 * with the new values and covers the read position, the device switches to it straight away.
+	 *
+	 * @param tempo_change Change in tempo (in percentage)
+	 * @param pitch_change Change in pitch (in number of semitones)
+	 */
+	void set_parameters(qreal tempo_change, int pitch_change);
+
+	/**
+	 * Set the rendition that will be played from the next call to seek_us() onwards. The rendition is used only if
+	 * it has been generated with the current tempo and pitch changes. Pass an invalid rendition to go back to
+	 * processing the source on the fly.
+	 *
+	 * @param rendition
+	 */
+	void set_rendition(const Rendition &rendition);
+
+	/**
+	 * Move the read position to the given time, expressed in microseconds of the original (unstretched) stream.
+	 *
+	 * @param original_us
+	 */
+	void seek_us(qint64 original_us);
+
+	/**
+	 * Set the region that is played. Takes effect from the next call to seek_us() onwards.
+	 *
+	 * @param start_us Beginning of the region (in microseconds of the original stream)
+	 * @param end_us End of the region (in microseconds of the original stream). Pass a negative value to play up to the end of the source
+	 */
+	void set_boundaries(qint64 start_us, qint64 end_us);
+
+	/**
+	 * Enable or disable looping. If enabled, the device never reaches its end: whenever the end boundary is reached,
+	 * playing continues from the start boundary.
+	 *
+	 * @param enabled
+	 * @param crossfade_us Length of the crossfade between the end and the beginning of the loop (in microseconds of
+	 * the stretched stream). Pass 0 to join them without any crossfade
+	 */
+	void set_looping(bool enabled, qint64 crossfade_us = 0);
+
+	/**
+	 * Map a playing time onto the original stream, taking into account all the tempo changes that took place since
+	 * the last call to seek_us(), as well as the loop passes.
+	 *
+	 * @param output_us Time elapsed since the last seek (in microseconds of the stretched stream)
+	 * @return The corresponding time (in microseconds of the original stream)
+	 */
+	qint64 original_us_at(qint64 output_us) const;
+
+	/**
+	 * Set the fill levels of the buffer that drive the feeder thread: whenever the amount of buffered audio drops
+	 * below the low watermark, the feeder tops the buffer up to the high watermark. Larger values make underruns
+	 * less likely, at the price of a higher latency when seeking or changing tempo and pitch.
+	 *
+	 * @param low_us Low watermark (in microseconds of the stretched stream)
+	 * @param high_us High watermark (in microseconds of the stretched stream)
+	 */
+	void set_watermarks(qint64 low_us, qint64 high_us);
+	qint64 low_watermark_us() const;
+	qint64 high_watermark_us() const;
+	/// Amount of audio (in microseconds of the stretched stream) that is ready to be read.
+	qint64 buffered_us() const;
+	/// Number of times the buffer ran dry while reading since the last seek. Silence is played in its place.
+	int underrun_count() const;
+
+	virtual bool isSequential() const;
+	virtual bool atEnd() const;
+	virtual qint64 bytesAvailable() const;
+
+protected:
+	virtual qint64 readData(char *data, qint64 maxlen);
+	virtual qint64 writeData(const char *data, qint64 len);
+
+private:
+	class Feeder;
+
+	/// Body of the feeder thread.
+	void _feed();
+	/// Append the next chunk of stretched audio to the ring buffer. Called by the feeder without holding _mutex.
+	void _produce();
+	/// Append the next chunk of stretched audio, taken either from the rendition or from SoundTouch, to _pending.
+	void _fill_pending();
+	/// Go back to the start boundary, crossfading if required.
+	void _wrap();
+	/// Start producing from the given time (in microseconds of the original stream), without touching the ring buffer.
+	void _reposition(qint64 original_us);
+	/**
+	 * Ask the feeder to drop the buffered audio and to start producing from the given time. Must be called with
+	 * _mutex locked.
+	 *
+	 * @param original_us Time (in microseconds of the original stream)
+	 * @param written_bytes Number of bytes the new audio is appended after, since the last seek
+	 */
+	void _request_restart(qint64 original_us, qint64 written_bytes);
+	/// Apply the last restart request. Called by the feeder with _mutex locked.
+	void _restart();
+	/// Like seek_us(). Must be called with _mutex locked.
+	void _seek(qint64 original_us);
+	/// Number of bytes in the ring buffer that have been produced since the last restart.
+	qint64 _buffered_bytes() const;
+	/// Number of bytes that can be produced before reaching the given time (in microseconds of the original stream).
+	qint64 _bytes_until(qint64 original_us) const;
+	/// The end boundary (in microseconds of the original stream).
+	qint64 _end_boundary() const;
+	/// Length (in bytes) of the crossfade between the end and the beginning of the loop.
+	qint64 _crossfade_bytes() const;
+	qint64 _original_us_at(qint64 output_us) const;
+	/// Feed a block of source samples to SoundTouch and collect the resulting output.
+	void _process_block();
+	/// Move all the samples that are ready in the SoundTouch pipeline to the _pending buffer.
+	void _receive_samples();
+	/// Start processing the source on the fly from the given time (in microseconds of the original stream).
+	void _seek_source(qint64 original_us);
+	/// Size the ring buffer and the watermarks according to the current source.
+	void _resize_ring();
+	/// Convert a number of output bytes into microseconds of the stretched stream.
+	qint64 _output_us(qint64 n_bytes) const;
+	/// Convert microseconds of the stretched stream into a number of whole frames' worth of bytes.
+	qint64 _output_bytes_for(qint64 output_us) const;
+
+	/// A point of the stretched stream from which a given tempo change applies.
+	struct Anchor {
+		/// Position (in microseconds of the stretched stream, measured from the last seek).
+		qint64 output_us;
+		/// Corresponding position (in microseconds of the original stream).
+		qint64 original_us;
+		qreal tempo_change;
+	};
+
+	/// What the device has been asked to do.
+	struct Settings {
+		qreal tempo_change;
+		int pitch_change;
+		/// Boundaries of the region that is played (in microseconds of the original stream).
+		qint64 start_us, end_us;
+		bool looping;
+		qint64 crossfade_us;
+		Rendition next_rendition;
+	};
+
+	/// Protects the settings, the restart requests and the anchors. It is only held briefly: the feeder produces
+	/// audio without it.
+	mutable QMutex _mutex;
+	QWaitCondition _wake;
+	/// Signalled when the feeder is done producing a chunk.
+	QWaitCondition _idle;
+	std::unique_ptr<Feeder> _feeder;
+	bool _quit;
+	/// True while the feeder is producing, which the source and the size of the buffer must not change during.
+	bool _producing;
+
+	/// The settings as they have been set, protected by _mutex.
+	Settings _settings;
+	/// The settings the feeder produces with, copied from _settings before producing. Tempo and pitch changes are
+	/// only copied when restarting.
+	Settings _active;
+
+	/// Number of restarts requested so far. Only changed with _mutex locked, but readData() checks it without.
+	std::atomic<qint64> _requested_generation;
+	/// Position and output byte count requested for the last restart.
+	qint64 _restart_us, _restart_written_bytes;
+	/// Number of restarts the feeder has applied so far. Audio is stale while it lags behind _requested_generation.
+	std::atomic<qint64> _generation;
+	/// Position of the ring buffer at the last restart: the bytes written before it are stale.
+	std::atomic<qint64> _discard_position;
+
+	// what follows belongs to the feeder: apart from it, only set_source() and set_watermarks() touch it, after
+	// waiting for the feeder to be idle
+
+	/// True while the feeder is topping the buffer up to the high watermark.
+	bool _refilling;
+
+	const SampleSource *_source;
+	/// The rendition that is being played, or an invalid rendition if the source is being processed on the fly.
+	Rendition _rendition;
+	/// Position (in bytes) of the next rendition byte to be buffered.
+	qint64 _rendition_byte;
+	ProcessorPool::Lease _stretcher;
+	int _channels;
+	int _sample_rate;
+
+	/// Index (in samples, all channels included) of the next source sample to be fed to SoundTouch.
+	qint64 _source_sample;
+	/// True if all the source samples have been fed and SoundTouch has been flushed.
+	bool _source_finished;
+
+	/// Used to read the source when its samples cannot be accessed directly.
+	std::vector<float> _in_buffer;
+	std::vector<float> _out_buffer;
+	/// Processed 16-bit samples that did not fit in the ring buffer yet.
+	QByteArray _pending;
+
+	/// Position (in microseconds of the original stream) of the first sample produced since the last jump.
+	qint64 _segment_start_us;
+	/// Number of bytes produced since the last jump.
+	qint64 _segment_bytes;
+	/// Number of bytes appended to the ring buffer since the last seek.
+	qint64 _written_bytes;
+
+	RingBuffer _ring;
+	/// True once all the audio up to the end of the source has been appended to the ring buffer.
+	std::atomic<bool> _feeding_finished;
+	qint64 _low_watermark_us, _high_watermark_us;
+	/// The watermarks, converted into bytes.
+	qint64 _low_watermark, _high_watermark;
+
+	/// Number of bytes of audio handed out since the last seek.
+	qint64 _output_bytes;
+	/// Number of bytes of silence handed out since the last seek to make up for underruns.
+	qint64 _silent_bytes;
+	int _underruns;
+	/// The tempo changes and the loop passes that took place since the last seek, sorted by output_us. The feeder appends to it, hence _mutex.
+	mutable std::vector<Anchor> _anchors;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_SOUNDUTILS_STRETCHDEVICE_H_ */
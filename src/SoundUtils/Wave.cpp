@@ -8,91 +8,277 @@
 #include <fstream>
 #include <errno.h>
 #include <cstring>
+#include <algorithm>
 #include "Wave.h"
 
 #include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 using namespace cb;
 
-Wave::Wave(const QString &filename) throw (std::exception) {
-	_fmt.wFormatTag = 0;
-	_extra_param_length = 0;
-	_fact.samplesNumber = -1;
+namespace {
 
-	QFile file(filename);
-	file.open(QIODevice::ReadOnly);
-	if(file.isOpen() == false) {
+/// The header that precedes every RIFF chunk.
+struct ChunkHeader {
+	char id[4];
+	quint32 size;
+};
+
+/// The header that precedes every Wave64 chunk. Its size includes the header itself.
+struct Wave64ChunkHeader {
+	unsigned char guid[16];
+	quint64 size;
+};
+
+/// The part of the ds64 chunk of RF64 files that we use.
+struct DS64 {
+	quint64 riff_size;
+	quint64 data_size;
+	quint64 sample_count;
+};
+
+/// Size of the body of the ds64 chunks we write: the three 64-bit sizes and an empty table.
+const quint32 DS64_SIZE = 28;
+/// Value of the 32-bit sizes of RF64 files that are stored in the ds64 chunk instead.
+const quint32 RF64_SIZE_IN_DS64 = 0xFFFFFFFF;
+/// Wave64 header: riff GUID, 64-bit size, wave GUID.
+const int WAVE64_HEADER_SIZE = 40;
+
+const unsigned char WAVE64_RIFF[16] = { 'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00 };
+const unsigned char WAVE64_WAVE[16] = { 'w', 'a', 'v', 'e', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+const unsigned char WAVE64_FMT[16] = { 'f', 'm', 't', ' ', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+const unsigned char WAVE64_DATA[16] = { 'd', 'a', 't', 'a', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+
+/// Round up to a multiple of 8, the alignment of Wave64 chunks.
+qint64 align_wave64(qint64 size) {
+	return (size + 7) & ~((qint64) 7);
+}
+
+template<typename T>
+void write_value(QIODevice &file, T value) {
+	file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void write_padding(QIODevice &file, qint64 n_bytes) {
+	static const char zeros[8] = { 0 };
+	if(n_bytes > 0) file.write(zeros, n_bytes);
+}
+
+} /* namespace */
+
+Wave::Wave(const QString &filename, Storage storage) throw (std::exception) : Wave() {
+	std::shared_ptr<QFile> file = std::make_shared<QFile>(filename);
+	file->open(QIODevice::ReadOnly);
+	if(file->isOpen() == false) {
 		throw std::runtime_error(strerror( errno));
 	}
 
-	file.read(reinterpret_cast<char*>(&_riff), RIFF_SIZE);
-	file.read(reinterpret_cast<char*>(&_fmthdr), FMTHDR_SIZE);
+	qint64 data_size;
+	qint64 data_offset = _read_header(*file, data_size);
 
-	file.read(reinterpret_cast<char*>(&_fmt), FMT_SIZE);
+	if(!_init_codec()) {
+		throw std::runtime_error("Unsupported format: only 8, 16, 24 and 32 bit integer and 32 bit float wav files are supported");
+	}
 
-	unsigned fmt_extra_bytes = _fmthdr.fmtSIZE - FMT_SIZE;
+	// truncated files (e.g. recordings that have been interrupted) contain less data than declared
+	data_size = qBound((qint64) 0, data_size, file->size() - data_offset);
+
+	if(storage == MAPPED && data_size > 0) {
+		uchar *data = file->map(data_offset, data_size);
+		if(data != nullptr) {
+			_advise_sequential(data, data_size);
+			// the samples stay in the page cache, and are copied only if modified
+			_mapped_data = reinterpret_cast<const char *>(data);
+			_mapped_size = data_size;
+			_mapped_file = file;
+			return;
+		}
+	}
 
-	if(fmt_extra_bytes > 0) {
-		_fmt_extra_bytes.resize(fmt_extra_bytes);
+	// mapping is not possible (or not wanted): the samples are read into memory
+	_buffer.resize(data_size);
+	file->seek(data_offset);
+	_buffer.resize(std::max((qint64) 0, file->read(_buffer.data(), data_size)));
+}
 
-		file.read(&_fmt_extra_bytes[0], fmt_extra_bytes);
+Wave::Info Wave::probe(const QString &filename) throw (std::exception) {
+	QFile file(filename);
+	if(!file.open(QIODevice::ReadOnly)) {
+		throw std::runtime_error(strerror( errno));
 	}
 
-	if(_fmt.wFormatTag != 1) {
-		throw std::runtime_error("Unsupported format: only wav files with format tag == 1 are supported");
+	Wave header;
+	Info info;
+	info.data_offset = header._read_header(file, info.data_size);
+	info.data_size = qBound((qint64) 0, info.data_size, file.size() - info.data_offset);
+	info.container = header._container;
+	// the format is what the file declares, whether it is supported or not
+	header._init_codec();
+	info.format = header.format();
+	qint64 frame_size = header._fmt.nBlockAlign;
+	info.duration_us = (frame_size > 0 && header._fmt.nSamplesPerSec > 0) ? (info.data_size / frame_size) * 1000000 / header._fmt.nSamplesPerSec : 0;
+
+	return info;
+}
+
+qint64 Wave::_read_header(QFile &file, qint64 &data_size) {
+	char header[WAVE64_HEADER_SIZE];
+	qint64 n_read = file.read(header, WAVE64_HEADER_SIZE);
+
+	if(n_read >= RIFF_SIZE && memcmp(header + 8, "WAVE", 4) == 0) {
+		// BW64 is the name RF64 goes by in ITU-R BS.2088
+		if(memcmp(header, "RIFF", 4) == 0) _container = RIFF_WAVE;
+		else if(memcmp(header, "RF64", 4) == 0 || memcmp(header, "BW64", 4) == 0) _container = RF64;
+		else throw std::runtime_error("Not a wav file");
+		return _walk_riff_chunks(file, data_size);
 	}
 
-	if(get_bytes_per_sample() != 2) {
-		throw std::runtime_error("Unsupported format: only 16 bit wav files are currently supported");
+	if(n_read == WAVE64_HEADER_SIZE && memcmp(header, WAVE64_RIFF, 16) == 0 && memcmp(header + 24, WAVE64_WAVE, 16) == 0) {
+		_container = WAVE64;
+		return _walk_wave64_chunks(file, data_size);
 	}
 
-	file.read(reinterpret_cast<char*>(&_data.dataID), 4);
+	throw std::runtime_error("Not a wav file");
+}
+
+qint64 Wave::_walk_riff_chunks(QFile &file, qint64 &data_size) {
+	// walk the chunks until both fmt and data have been found, whatever their order and whatever comes in between
+	// (LIST, bext, JUNK...). Unknown chunks are skipped
+	bool fmt_found = false;
+	qint64 data_offset = -1;
+	qint64 ds64_data_size = -1;
+	qint64 chunk_offset = RIFF_SIZE;
+	while(!fmt_found || data_offset < 0) {
+		ChunkHeader chunk;
+		if(!file.seek(chunk_offset) || file.read(reinterpret_cast<char*>(&chunk), sizeof(chunk)) != sizeof(chunk)) break;
+		qint64 body_offset = chunk_offset + sizeof(chunk);
+		qint64 chunk_size = chunk.size;
+
+		if(memcmp(chunk.id, "fmt ", 4) == 0) {
+			_read_fmt(file, body_offset, chunk_size);
+			fmt_found = true;
+		}
+		else if(memcmp(chunk.id, "ds64", 4) == 0 && _container == RF64) {
+			DS64 ds64;
+			if(chunk_size < (qint64) sizeof(ds64) || file.read(reinterpret_cast<char*>(&ds64), sizeof(ds64)) != sizeof(ds64)) {
+				throw std::runtime_error("Invalid wav file: malformed ds64 chunk");
+			}
+			ds64_data_size = ds64.data_size;
+		}
+		else if(memcmp(chunk.id, "fact", 4) == 0 && chunk_size == 4) {
+			// FACT holds the size of the chunk followed by its content, which is how save() writes it back
+			_fact.samplesNumber = chunk.size;
+			file.read(reinterpret_cast<char*>(&_fact.t), 4);
+		}
+		else if(memcmp(chunk.id, "data", 4) == 0) {
+			// the real size of the data chunks of RF64 files is in the ds64 chunk
+			if(chunk.size == RF64_SIZE_IN_DS64 && ds64_data_size >= 0) chunk_size = ds64_data_size;
+			data_size = chunk_size;
+			data_offset = body_offset;
+		}
 
-	if(_data.dataID[0] == 'f' && _data.dataID[1] == 'a' && _data.dataID[2] == 'c' && _data.dataID[3] == 't') {
-		file.read(reinterpret_cast<char*>(&_fact), FACT_SIZE);
-		file.read(reinterpret_cast<char*>(&_data), DATA_SIZE);
+		// chunks are word-aligned
+		chunk_offset = body_offset + chunk_size + (chunk_size & 1);
 	}
-	else file.read(reinterpret_cast<char*>(&_data.dataSIZE), 4);
 
-	_wave.resize(_data.dataSIZE);
+	if(!fmt_found) throw std::runtime_error("Invalid wav file: no fmt chunk");
+	if(data_offset < 0) throw std::runtime_error("Invalid wav file: no data chunk");
 
-	_wave = file.read(_data.dataSIZE);
+	return data_offset;
 }
 
-Wave::Wave() {
+qint64 Wave::_walk_wave64_chunks(QFile &file, qint64 &data_size) {
+	bool fmt_found = false;
+	qint64 data_offset = -1;
+	qint64 chunk_offset = WAVE64_HEADER_SIZE;
+	while(!fmt_found || data_offset < 0) {
+		Wave64ChunkHeader chunk;
+		if(!file.seek(chunk_offset) || file.read(reinterpret_cast<char*>(&chunk), sizeof(chunk)) != sizeof(chunk)) break;
+		if(chunk.size < sizeof(chunk)) throw std::runtime_error("Invalid wav file: malformed chunk");
+		qint64 body_offset = chunk_offset + sizeof(chunk);
+		qint64 body_size = chunk.size - sizeof(chunk);
+
+		if(memcmp(chunk.guid, WAVE64_FMT, 16) == 0) {
+			_read_fmt(file, body_offset, body_size);
+			fmt_found = true;
+		}
+		else if(memcmp(chunk.guid, WAVE64_DATA, 16) == 0) {
+			data_size = body_size;
+			data_offset = body_offset;
+		}
+
+		// chunks are aligned to 8 bytes
+		chunk_offset += align_wave64(chunk.size);
+	}
+
+	if(!fmt_found) throw std::runtime_error("Invalid wav file: no fmt chunk");
+	if(data_offset < 0) throw std::runtime_error("Invalid wav file: no data chunk");
+
+	return data_offset;
+}
+
+int Wave::_format_tag() const {
+	// the subformat GUID follows cbSize, wValidBitsPerSample and dwChannelMask
+	if((quint16) _fmt.wFormatTag == FORMAT_EXTENSIBLE && _fmt_extra_bytes.size() >= 24) {
+		quint16 tag;
+		memcpy(&tag, &_fmt_extra_bytes[8], 2);
+		return tag;
+	}
+	return (quint16) _fmt.wFormatTag;
+}
+
+bool Wave::_init_codec() {
+	SampleCodec::Format sample_format;
+	if(_fmt.nChannels < 1 || !SampleCodec::format_of(_format_tag(), get_bits_per_sample(), sample_format)) {
+		_codec = SampleCodec();
+		return false;
+	}
+	_codec = SampleCodec(sample_format, get_channels());
+	return true;
+}
+
+void Wave::_read_fmt(QFile &file, qint64 body_offset, qint64 size) {
+	if(size < FMT_SIZE || body_offset + size > file.size() || file.read(reinterpret_cast<char*>(&_fmt), FMT_SIZE) != FMT_SIZE) {
+		throw std::runtime_error("Invalid wav file: malformed fmt chunk");
+	}
+	memcpy(_fmthdr.fmtID, "fmt ", 4);
+	_fmthdr.fmtSIZE = size;
+	_fmt_extra_bytes.resize(size - FMT_SIZE);
+	if(!_fmt_extra_bytes.empty()) file.read(&_fmt_extra_bytes[0], _fmt_extra_bytes.size());
+}
+
+Wave::Wave() :
+				_mapped_data(nullptr),
+				_mapped_size(0),
+				_container(RIFF_WAVE) {
 	_extra_param_length = 0;
 	_fmt.wFormatTag = 0;
 	_fact.samplesNumber = -1;
 }
 
-Wave::Wave(int16_t nChannels, int32_t nSamplesPerSec, int16_t wBitsPerSample) throw (std::exception) {
+Wave::Wave(int16_t nChannels, int32_t nSamplesPerSec, int16_t wBitsPerSample, bool float_samples) throw (std::exception) : Wave() {
 	int16_t bytes = (wBitsPerSample + 7) / 8;
 
-	memcpy(_riff.riffID, "RIFF", 4);
-	_riff.riffSIZE = 0;
-
-	memcpy(_riff.riffFORMAT, "WAVE", 4);
-
 	memcpy(_fmthdr.fmtID, "fmt ", 4);
 	_fmthdr.fmtSIZE = sizeof(FMT);
 
-	_fmt.wFormatTag = 1;
+	_fmt.wFormatTag = float_samples ? FORMAT_IEEE_FLOAT : FORMAT_PCM;
 	_fmt.nChannels = nChannels;
 	_fmt.nSamplesPerSec = nSamplesPerSec;
 	_fmt.nAvgBytesPerSec = nChannels * nSamplesPerSec * bytes;
 	_fmt.nBlockAlign = nChannels * bytes;
 	_fmt.wBitsPerSample = wBitsPerSample;
 
-	_extra_param_length = 0;
-	_fact.samplesNumber = -1;
-
-	memcpy(_data.dataID, "data", 4);
-	_data.dataSIZE = 0;
-
-	_update_riff_size();
+	if(!_init_codec()) throw std::runtime_error("Unsupported format: " + std::to_string(wBitsPerSample) + " bit " + (float_samples ? "float" : "integer") + " samples");
 }
 
-Wave::Wave(const Wave& w) {
+Wave::Wave(const Wave& w) : Wave() {
 	_init(w);
 }
 Wave& Wave::operator=(const Wave &w) {
@@ -106,24 +292,10 @@ Wave Wave::operator+(const Wave &w) const throw (std::exception) {
 	if(_fmt.wFormatTag != w._fmt.wFormatTag) throw std::runtime_error("Can't concatenate waves with different format tags");
 
 	Wave res;
-	res._fmthdr = w._fmthdr;
-	res._fmt = w._fmt;
-	res._fmt_extra_bytes = w._fmt_extra_bytes;
-
-	res._riff = w._riff;
-	res._data = w._data;
-	res._data.dataSIZE = _data.dataSIZE + w._data.dataSIZE;
-
-	res._extra_param_length = w._extra_param_length;
-	if(w._extra_param_length) {
-		res._extra_param = w._extra_param;
-	}
-
-	res._wave = _wave;
-
-	res._wave.append(w._wave);
-
-	res._update_riff_size();
+	res._init_format(w);
+	res.reserve_samples(get_n_samples() + w.get_n_samples());
+	res._append_bytes(data(), get_data_size());
+	res._append_bytes(w.data(), w.get_data_size());
 
 	return res;
 }
@@ -142,38 +314,29 @@ Wave& Wave::operator+=(const Wave &w) throw (std::exception) {
 
 	if(_fmt.wBitsPerSample != w._fmt.wBitsPerSample) throw std::runtime_error("different number of bits per sample");
 
-	_wave.append(w._wave);
-
-	_data.dataSIZE += w._data.dataSIZE;
-
-	_update_riff_size();
+	_append_bytes(w.data(), w.get_data_size());
 
 	return *this;
 }
 
-void Wave::_init(const Wave& w) {
+void Wave::_init_format(const Wave& w) {
 	_fmthdr = w._fmthdr;
 	_fmt = w._fmt;
+	_codec = w._codec;
 	_fmt_extra_bytes = w._fmt_extra_bytes;
-	_riff = w._riff;
-	_data = w._data;
 	_fact = w._fact;
+	_container = w._container;
 
 	_extra_param_length = w._extra_param_length;
 	if(w._extra_param_length) _extra_param = w._extra_param;
-	_wave = w._wave;
-}
-
-int32_t Wave::calc_riff_size(int32_t fmtSIZE, int32_t dataSIZE) {
-	return RIFF_SIZE - 4 + FMTHDR_SIZE + fmtSIZE + DATA_SIZE + dataSIZE;
 }
 
-void Wave::_update_riff_size() {
-	_riff.riffSIZE = calc_riff_size(_fmthdr.fmtSIZE, _data.dataSIZE);
-}
-
-void Wave::_update_data_size() {
-	_data.dataSIZE = _wave.size();
+void Wave::_init(const Wave& w) {
+	_init_format(w);
+	_buffer = w._buffer;
+	_mapped_data = w._mapped_data;
+	_mapped_size = w._mapped_size;
+	_mapped_file = w._mapped_file;
 }
 
 int16_t Wave::get_channels() const {
@@ -196,11 +359,11 @@ int32_t Wave::get_avg_bytes_per_sec() const {
 	return _fmt.nAvgBytesPerSec;
 }
 
-int32_t Wave::get_data_size() const {
-	return _data.dataSIZE;
+qint64 Wave::get_data_size() const {
+	return is_mapped() ? _mapped_size : (qint64) _buffer.size();
 }
 
-int32_t Wave::get_n_samples() const {
+qint64 Wave::get_n_samples() const {
 	return get_data_size() / get_bytes_per_sample();
 }
 
@@ -208,12 +371,15 @@ qreal Wave::duration() const {
 	return get_n_samples() / (qreal) (get_samples_per_sec()*get_channels());
 }
 
-qint64 Wave::bytes_from_us(qint64 us) const {
-	qreal time_in_seconds = us / (qreal) 1000000.;
-	qint64 n_sample = time_in_seconds * get_samples_per_sec() * get_channels();
-	qint64 n_byte = n_sample * get_bytes_per_sample();
+qint64 Wave::duration_us() const {
+	qint64 n_frames = get_n_samples() / get_channels();
+	return n_frames * 1000000 / get_samples_per_sec();
+}
 
-	return n_byte;
+qint64 Wave::bytes_from_us(qint64 us) const {
+	// integer arithmetic is exact up to hundreds of years of audio, and always gives the beginning of a frame
+	qint64 n_frames = us * get_samples_per_sec() / 1000000;
+	return n_frames * get_channels() * get_bytes_per_sample();
 }
 
 QAudioFormat Wave::format() const {
@@ -222,85 +388,131 @@ QAudioFormat Wave::format() const {
 	frmt.setSampleRate(get_samples_per_sec());
 	frmt.setSampleSize(get_bits_per_sample());
 	frmt.setCodec("audio/pcm");
-	if(get_bytes_per_sample() == 1) frmt.setSampleType(QAudioFormat::UnSignedInt);
+	if(_codec.is_valid() && _codec.format() == SampleCodec::FLOAT32) frmt.setSampleType(QAudioFormat::Float);
+	else if(get_bytes_per_sample() == 1) frmt.setSampleType(QAudioFormat::UnSignedInt);
 	else frmt.setSampleType(QAudioFormat::SignedInt);
 	return frmt;
 }
 
-QByteArray *Wave::data() {
-	return &_wave;
+const SampleCodec &Wave::codec() const {
+	return _codec;
+}
+
+const char *Wave::data() const {
+	return is_mapped() ? _mapped_data : _buffer.data();
 }
 
-int Wave::get_samples(unsigned int offset, unsigned int n_samples, std::vector<float> &samples) const {
-	unsigned int byte_offset = offset * get_bytes_per_sample();
-	if(byte_offset > (unsigned) get_data_size()) return 0;
+int Wave::channels() const {
+	return get_channels();
+}
 
-	int byte_size = n_samples * get_bytes_per_sample();
-	unsigned int real_size = (byte_offset + byte_size) < (unsigned) get_data_size() ? byte_size : (unsigned) get_data_size() - byte_offset;
-	unsigned int real_n_samples = real_size / get_bytes_per_sample();
+int Wave::sample_rate() const {
+	return get_samples_per_sec();
+}
 
-	switch(get_bytes_per_sample()) {
-	case 2: {
-		const short *data_short = reinterpret_cast<const short *>(_wave.data() + byte_offset);
-		double conv = 1.0 / 32768.0;
-		for(uint i = 0; i < real_n_samples; i++) {
-			short value_s = data_short[i];
-			float value_f = (float) (value_s * conv);
-			samples.push_back(value_f);
-		}
-		break;
-	}
-	}
+qint64 Wave::n_samples() const {
+	return get_n_samples();
+}
+
+qint64 Wave::read(qint64 offset, qint64 n_samples, float *dest) const {
+	return get_samples(offset, n_samples, dest);
+}
+
+const float *Wave::samples(qint64 offset, qint64 n_samples) const {
+	Q_UNUSED(n_samples);
+	if(!_codec.is_valid() || _codec.format() != SampleCodec::FLOAT32) return nullptr;
+
+	// the data chunk of a mapped file can start at any byte
+	const char *first = data() + offset * get_bytes_per_sample();
+	if(reinterpret_cast<quintptr>(first) % alignof(float) != 0) return nullptr;
+	return reinterpret_cast<const float *>(first);
+}
+
+qint64 Wave::get_samples(qint64 offset, qint64 n_samples, std::vector<float> &samples) const {
+	size_t old_size = samples.size();
+	samples.resize(old_size + _available_samples(offset, n_samples));
+	return get_samples(offset, n_samples, samples.data() + old_size);
+}
+
+qint64 Wave::get_samples(qint64 offset, qint64 n_samples, float *samples) const {
+	qint64 real_n_samples = _available_samples(offset, n_samples);
+	if(real_n_samples > 0) _codec.decode(data() + offset * get_bytes_per_sample(), samples, real_n_samples);
 
 	return real_n_samples;
 }
 
-void Wave::get_samples(unsigned int offset, unsigned int size, QByteArray &samples) const {
-	if(offset > (unsigned) _data.dataSIZE) return;
+qint64 Wave::_available_samples(qint64 offset, qint64 n_samples) const {
+	// the samples of unsupported formats cannot be converted
+	if(!_codec.is_valid()) return 0;
+
+	qint64 total = get_n_samples();
+	if(offset < 0 || offset > total) return 0;
+	return std::min(n_samples, total - offset);
+}
 
-	unsigned int real_size = (offset + size) < (unsigned) _data.dataSIZE ? size : (unsigned) _data.dataSIZE - offset;
+void Wave::get_samples(qint64 offset, qint64 size, QByteArray &samples) const {
+	if(offset < 0 || offset > get_data_size()) return;
 
-	samples.append(_wave.data() + offset, real_size);
+	qint64 real_size = std::min(size, get_data_size() - offset);
+
+	samples.append(data() + offset, real_size);
 }
 
-int Wave::_saturate(float fvalue, float minval, float maxval) {
-	if(fvalue > maxval) fvalue = maxval;
-	else if(fvalue < minval) fvalue = minval;
-	return (int) fvalue;
+void Wave::append_samples(const float *samples, qint64 n_samples) {
+	if(!_codec.is_valid()) throw std::logic_error("Wave::append_samples(): unsupported sample format");
+
+	_detach();
+	size_t old_size = _buffer.size();
+	// the samples are converted in place: no memory is allocated as long as there is enough room (see reserve_samples())
+	_buffer.resize(old_size + n_samples * get_bytes_per_sample());
+	_codec.encode(samples, _buffer.data() + old_size, n_samples);
 }
 
-void Wave::append_samples(const float *samples, int n_samples) {
-	int tot_byte = n_samples * get_bytes_per_sample();
-	QByteArray to_append(tot_byte, 0);
+bool Wave::is_mapped() const {
+	return _mapped_file != nullptr;
+}
 
-	switch(get_bytes_per_sample()) {
-	case 2: {
-		short *data_s = reinterpret_cast<short *>(to_append.data());
-		for(int i = 0; i < n_samples; i++) {
-			float value_f = samples[i];
-			short value_s = (short) _saturate(value_f * 32768.0f, -32768.0f, 32767.0f);
-			data_s[i] = value_s;
-		}
-	}
-	}
+Wave::Container Wave::container() const {
+	return _container;
+}
 
-	_wave.append(to_append);
-	_update_data_size();
-	_update_riff_size();
+void Wave::_advise_sequential(uchar *data, qint64 size) {
+#ifdef Q_OS_UNIX
+	// the advice must start at a page boundary
+	quintptr page_size = sysconf(_SC_PAGESIZE);
+	quintptr start = reinterpret_cast<quintptr>(data) & ~(page_size - 1);
+	posix_madvise(reinterpret_cast<void *>(start), size + (reinterpret_cast<quintptr>(data) - start), POSIX_MADV_SEQUENTIAL);
+#else
+	Q_UNUSED(data);
+	Q_UNUSED(size);
+#endif
 }
 
-void Wave::append_samples(const QByteArray &samples) {
-	_wave.append(samples);
+void Wave::_detach() {
+	if(!is_mapped()) return;
+
+	_buffer.assign(_mapped_data, _mapped_data + _mapped_size);
+	_mapped_data = nullptr;
+	_mapped_size = 0;
+	_mapped_file.reset();
+}
+
+void Wave::_append_bytes(const char *bytes, qint64 size) {
+	_detach();
+	_buffer.insert(_buffer.end(), bytes, bytes + size);
+}
 
-	_update_data_size();
-	_update_riff_size();
+void Wave::reserve_samples(qint64 n_samples) {
+	_detach();
+	_buffer.reserve(_buffer.size() + n_samples * get_bytes_per_sample());
 }
 
-void Wave::append_samples(const char *samples, int size) {
-	_wave.append(samples, size);
+void Wave::append_samples(const QByteArray &samples) {
+	_append_bytes(samples.constData(), samples.size());
+}
 
-	_update_data_size();
-	_update_riff_size();
+void Wave::append_samples(const char *samples, qint64 size) {
+	_append_bytes(samples, size);
 }
 
 void Wave::append_samples(const QByteArray &samples_l, const QByteArray &samples_r) {
@@ -308,52 +520,115 @@ void Wave::append_samples(const QByteArray &samples_l, const QByteArray &samples
 
 	if(samples_l.size() != samples_r.size()) throw std::logic_error(("Wave::append_samples(): samples have different sizes, l " + std::to_string(samples_l.size()) + " r " + std::to_string(samples_r.size())).c_str());
 
-	int bytes_per_sample = _fmt.wBitsPerSample / 8;
+	append_samples(samples_l.constData(), samples_r.constData(), samples_l.size());
+}
 
-	size_t size = samples_l.size();
+void Wave::append_samples(const char* samples_l, const char* samples_r, qint64 size) {
+	if(_fmt.nChannels != 2) throw std::logic_error(("Wave::append_samples(): cannot add stereo samples, nChannels = " + std::to_string(_fmt.nChannels)).c_str());
 
-	for(size_t i = 0; i < size; i = i + bytes_per_sample) {
-		_wave.append(samples_l.data() + i, bytes_per_sample);
-		_wave.append(samples_r.data() + i, bytes_per_sample);
-	}
+	int bytes_per_sample = _fmt.wBitsPerSample / 8;
 
-	_update_data_size();
-	_update_riff_size();
+	_detach();
+	_buffer.reserve(_buffer.size() + 2 * size);
+	for(qint64 i = 0; i < size; i = i + bytes_per_sample) {
+		_buffer.insert(_buffer.end(), samples_l + i, samples_l + i + bytes_per_sample);
+		_buffer.insert(_buffer.end(), samples_r + i, samples_r + i + bytes_per_sample);
+	}
 }
 
-void Wave::append_samples(const char* samples_l, const char* samples_r, int size) {
-	if(_fmt.nChannels != 2) throw std::logic_error(("Wave::append_samples(): cannot add stereo samples, nChannels = " + std::to_string(_fmt.nChannels)).c_str());
+void Wave::save(const QString &filename) const throw (std::exception) {
+	// the file is written aside and renamed over the old one, which stays alive for as long as it is mapped: saving
+	// over the file the samples are mapped from does not pull them from under this wave, or any thread reading it
+	QSaveFile file(filename);
+	if(!file.open(QIODevice::WriteOnly)) {
+		throw std::runtime_error(("Cannot open '" + filename.toStdString() + "' for writing").c_str());
+	}
 
-	int bytes_per_sample = _fmt.wBitsPerSample / 8;
+	if(QFileInfo(filename).suffix().toLower() == "w64") _save_wave64(file);
+	else _save_riff(file);
 
-	for(int i = 0; i < size; i = i + bytes_per_sample) {
-		_wave.append(samples_l + i, bytes_per_sample);
-		_wave.append(samples_r + i, bytes_per_sample);
+	if(!file.commit()) {
+		throw std::runtime_error(("Cannot write to '" + filename.toStdString() + "'").c_str());
 	}
+}
 
-	_update_data_size();
-	_update_riff_size();
+qint64 Wave::_fmt_chunk_size() const {
+	qint64 size = FMT_SIZE + _fmt_extra_bytes.size();
+	// the fmt chunks of formats other than PCM end with cbSize, which files that have been loaded already have
+	if(_fmt.wFormatTag != FORMAT_PCM && _fmt_extra_bytes.empty()) size += 2 + _extra_param_length;
+	return size;
 }
 
-void Wave::save(const QString &filename) {
-	QFile file(filename);
-	file.open(QIODevice::WriteOnly);
+void Wave::_write_fmt(QIODevice &file) const {
+	file.write(reinterpret_cast<const char*>(&_fmt), FMT_SIZE);
+	if(!_fmt_extra_bytes.empty()) file.write(&_fmt_extra_bytes[0], _fmt_extra_bytes.size());
 
-	file.write(reinterpret_cast<char*>(&_riff), RIFF_SIZE);
-	file.write(reinterpret_cast<char*>(&_fmthdr), FMTHDR_SIZE);
+	if(_fmt.wFormatTag != FORMAT_PCM && _fmt_extra_bytes.empty()) {
+		file.write(reinterpret_cast<const char*>(&_extra_param_length), 2);
+		if(_extra_param_length > 0) file.write(&_extra_param[0], _extra_param_length);
+	}
+}
 
-	file.write(reinterpret_cast<char*>(&_fmt), FMT_SIZE);
-	file.write(&_fmt_extra_bytes[0], _fmt_extra_bytes.size());
+void Wave::_save_riff(QIODevice &file) const {
+	qint64 fmt_size = _fmt_chunk_size();
+	qint64 data_size = get_data_size();
+	bool has_fact = _fact.samplesNumber > -1;
 
-	if(_fmt.wFormatTag > 1) {
-		file.write(reinterpret_cast<char*>(&_extra_param_length), 2);
-		if(_extra_param_length > 0) file.write(&_extra_param[0], _extra_param_length);
+	qint64 riff_size = 4 + FMTHDR_SIZE + fmt_size + (fmt_size & 1) + DATA_SIZE + data_size + (data_size & 1);
+	if(has_fact) riff_size += 4 + FACT_SIZE;
+	// files that do not fit in 32-bit sizes are saved as RF64, which has no use for the fact chunk
+	bool rf64 = riff_size >= (qint64) RF64_SIZE_IN_DS64;
+	if(rf64) {
+		if(has_fact) riff_size -= 4 + FACT_SIZE;
+		has_fact = false;
+		riff_size += FMTHDR_SIZE + DS64_SIZE;
 	}
-	if(_fact.samplesNumber > -1) {
-		file.write(const_cast<char*>("fact"), 4);
-		file.write(reinterpret_cast<char*>(&_fact), FACT_SIZE);
+
+	file.write(rf64 ? "RF64" : "RIFF", 4);
+	write_value<quint32>(file, rf64 ? RF64_SIZE_IN_DS64 : riff_size);
+	file.write("WAVE", 4);
+
+	if(rf64) {
+		file.write("ds64", 4);
+		write_value<quint32>(file, DS64_SIZE);
+		write_value<quint64>(file, riff_size);
+		write_value<quint64>(file, data_size);
+		write_value<quint64>(file, get_n_samples() / get_channels());
+		// no table of other chunk sizes
+		write_value<quint32>(file, 0);
 	}
 
-	file.write(reinterpret_cast<char*>(&_data), DATA_SIZE);
-	file.write(_wave.data(), _data.dataSIZE);
+	file.write("fmt ", 4);
+	write_value<quint32>(file, fmt_size);
+	_write_fmt(file);
+	write_padding(file, fmt_size & 1);
+
+	if(has_fact) {
+		file.write("fact", 4);
+		file.write(reinterpret_cast<const char*>(&_fact), FACT_SIZE);
+	}
+
+	file.write("data", 4);
+	write_value<quint32>(file, rf64 ? RF64_SIZE_IN_DS64 : data_size);
+	file.write(data(), data_size);
+	write_padding(file, data_size & 1);
+}
+
+void Wave::_save_wave64(QIODevice &file) const {
+	qint64 fmt_chunk_size = sizeof(Wave64ChunkHeader) + _fmt_chunk_size();
+	qint64 data_chunk_size = sizeof(Wave64ChunkHeader) + get_data_size();
+
+	file.write(reinterpret_cast<const char*>(WAVE64_RIFF), 16);
+	write_value<quint64>(file, WAVE64_HEADER_SIZE + align_wave64(fmt_chunk_size) + align_wave64(data_chunk_size));
+	file.write(reinterpret_cast<const char*>(WAVE64_WAVE), 16);
+
+	file.write(reinterpret_cast<const char*>(WAVE64_FMT), 16);
+	write_value<quint64>(file, fmt_chunk_size);
+	_write_fmt(file);
+	write_padding(file, align_wave64(fmt_chunk_size) - fmt_chunk_size);
+
+	file.write(reinterpret_cast<const char*>(WAVE64_DATA), 16);
+	write_value<quint64>(file, data_chunk_size);
+	file.write(data(), get_data_size());
+	write_padding(file, align_wave64(data_chunk_size) - data_chunk_size);
 }
@@ -11,20 +11,64 @@
 #include <QAudioFormat>
 #include <QByteArray>
 
+#include "SampleCodec.h"
+#include "SampleSource.h"
+
 #include <string>
 #include <vector>
+#include <memory>
 #include <stdint.h>
 #include <exception>
 
+class QFile;
+class QIODevice;
+
 namespace cb {
 
-class Wave {
+/**
+ * The samples of a wav file, in the format they come in. As a SampleSource, a wave decodes its samples to floats as
+ * they are read, hence a mapped file can be played and processed without being copied into memory.
+ */
+class Wave: public SampleSource {
 public:
+	/// How the samples of a wav file are accessed.
+	enum Storage {
+		/// The samples are copied into memory.
+		IN_MEMORY,
+		/// The file is mapped into memory: opening it is immediate and the samples are read from the page cache when
+		/// accessed. The wave is copied into memory only if it is modified.
+		MAPPED
+	};
+
+	/// The container formats wav files come in.
+	enum Container {
+		/// Plain RIFF/WAVE, limited to 4 GB.
+		RIFF_WAVE,
+		/// RIFF/WAVE with 64-bit sizes stored in a ds64 chunk (EBU Tech 3306, also known as BW64).
+		RF64,
+		/// Sony Wave64: GUID-based chunks with 64-bit sizes.
+		WAVE64
+	};
+
+	/// Format tags of the fmt chunk.
+	static const int FORMAT_PCM = 1;
+	static const int FORMAT_IEEE_FLOAT = 3;
+	/// The actual format tag is in the first two bytes of the subformat GUID.
+	static const int FORMAT_EXTENSIBLE = 0xFFFE;
+
 	Wave();
-	Wave(const QString &filename) throw (std::exception);
+	/**
+	 * Load a wav file. 8, 16, 24 and 32-bit integer samples and 32-bit float samples are supported, whether they are
+	 * declared in a plain or in an extensible fmt chunk.
+	 *
+	 * @param filename
+	 * @param storage
+	 */
+	Wave(const QString &filename, Storage storage = MAPPED) throw (std::exception);
 	Wave(const Wave& w);
 
-	Wave(int16_t nChannels, int32_t nSamplesPerSec, int16_t wBitsPerSample) throw (std::exception);
+	/// An empty wave with integer samples (floats, if float_samples is true and wBitsPerSample is 32).
+	Wave(int16_t nChannels, int32_t nSamplesPerSec, int16_t wBitsPerSample, bool float_samples = false) throw (std::exception);
 
 	virtual ~Wave();
 
@@ -37,23 +81,90 @@ public:
 	int16_t get_bytes_per_sample() const;
 	int32_t get_samples_per_sec() const;
 	int32_t get_avg_bytes_per_sec() const;
-	int32_t get_data_size() const;
-	int32_t get_n_samples() const;
+	/// Size (in bytes) of the samples.
+	qint64 get_data_size() const;
+	/// Number of samples, all channels included.
+	qint64 get_n_samples() const;
 	qreal duration() const;
+	qint64 duration_us() const;
+	/// Position (in bytes) of the frame that starts at the given time.
 	qint64 bytes_from_us(qint64 us) const;
 	QAudioFormat format() const;
-	QByteArray *data();
+	/// The codec used to convert the samples from and to floats. It is invalid if the format is not supported.
+	const SampleCodec &codec() const;
+	/// True if the samples are read directly from a memory-mapped file.
+	bool is_mapped() const;
+	/// The container the wave has been read from (RIFF_WAVE for waves that have been built in memory).
+	Container container() const;
+	/// The raw samples, get_data_size() bytes long.
+	const char *data() const;
+
+	virtual int channels() const;
+	virtual int sample_rate() const;
+	virtual qint64 n_samples() const;
+	/// Same as get_samples(). Samples in an unsupported format cannot be read.
+	virtual qint64 read(qint64 offset, qint64 n_samples, float *dest) const;
+	/// Direct access is only supported for float samples that are suitably aligned.
+	virtual const float *samples(qint64 offset, qint64 n_samples) const;
 
-	int get_samples(unsigned int offset, unsigned int n_samples, std::vector<float> &samples) const;
-	void get_samples(unsigned int offset, unsigned int size, QByteArray &samples) const;
+	/**
+	 * Append samples, converted to floats, to the given vector.
+	 *
+	 * @param offset Position of the first sample (all channels included)
+	 * @param n_samples Maximum number of samples to be read
+	 * @param samples
+	 * @return The number of samples read
+	 */
+	qint64 get_samples(qint64 offset, qint64 n_samples, std::vector<float> &samples) const;
+	/**
+	 * Read samples, converted to floats, into a buffer provided by the caller. No memory is allocated.
+	 *
+	 * @param offset Position of the first sample (all channels included)
+	 * @param n_samples Maximum number of samples to be read
+	 * @param samples Buffer with room for at least n_samples samples
+	 * @return The number of samples read
+	 */
+	qint64 get_samples(qint64 offset, qint64 n_samples, float *samples) const;
+	void get_samples(qint64 offset, qint64 size, QByteArray &samples) const;
 
-	void append_samples(const float *samples, int n_samples);
+	void append_samples(const float *samples, qint64 n_samples);
+	/// Make room for n_samples more samples, so that appending them does not reallocate the buffer.
+	void reserve_samples(qint64 n_samples);
 	void append_samples(const QByteArray &samples);
-	void append_samples(const char *samples, int size);
+	void append_samples(const char *samples, qint64 size);
 	void append_samples(const QByteArray &samples_l, const QByteArray &samples_r);
-	void append_samples(const char* samples_l, const char *samples_r, int size);
+	void append_samples(const char* samples_l, const char *samples_r, qint64 size);
+
+	/**
+	 * Save the wave. Files with the w64 extension are saved as Wave64. The others are saved as plain RIFF/WAVE,
+	 * unless they would exceed 4 GB, in which case they are saved as RF64.
+	 *
+	 * The wave is left untouched, hence it can be saved while other threads read it, even over the file its samples
+	 * are mapped from.
+	 *
+	 * @param filename
+	 */
+	void save(const QString &filename) const throw (std::exception);
 
-	void save(const QString &filename);
+	/// What can be known about a wav file without loading its samples.
+	struct Info {
+		QAudioFormat format;
+		Container container;
+		/// Position (in bytes) of the samples in the file.
+		qint64 data_offset;
+		/// Size (in bytes) of the samples.
+		qint64 data_size;
+		qint64 duration_us;
+	};
+
+	/**
+	 * Read the format and the duration of a wav file, looking only at its headers. Formats that cannot be loaded
+	 * are reported as well.
+	 *
+	 * @param filename
+	 * @return
+	 */
+	static Info probe(const QString &filename) throw (std::exception);
 
 	struct RIFF {
 		char riffID[4];     //4
@@ -92,23 +203,56 @@ public:
 	static const int FACT_SIZE = 8;
 
 private:
+	/// Copy everything but the samples.
+	void _init_format(const Wave&);
 	void _init(const Wave&);
+	/**
+	 * Read the header of a wav file and walk its chunks, filling the format.
+	 *
+	 * @param file
+	 * @param data_size Set to the size (in bytes) of the samples, as declared by the file
+	 * @return The position (in bytes) of the samples in the file
+	 */
+	qint64 _read_header(QFile &file, qint64 &data_size);
+	/// The format tag, with the one of extensible fmt chunks taken from their subformat.
+	int _format_tag() const;
+	/// Pick the codec for the current format.
+	bool _init_codec();
+	qint64 _walk_riff_chunks(QFile &file, qint64 &data_size);
+	qint64 _walk_wave64_chunks(QFile &file, qint64 &data_size);
+	/// Read the body of a fmt chunk.
+	void _read_fmt(QFile &file, qint64 body_offset, qint64 size);
+	/// Save as RIFF/WAVE or, if the wave does not fit in 4 GB, as RF64.
+	void _save_riff(QIODevice &file) const;
+	void _save_wave64(QIODevice &file) const;
+	/// Size (in bytes) of the body of the fmt chunk written by save().
+	qint64 _fmt_chunk_size() const;
+	void _write_fmt(QIODevice &file) const;
 
-	static int32_t calc_riff_size(int32_t fmtSIZE, int32_t dataSIZE);
-	void _update_riff_size();
-	void _update_data_size();
-
-	inline int _saturate(float fvalue, float minval, float maxval);
+	/// Number of samples that can be read starting from offset, up to n_samples.
+	qint64 _available_samples(qint64 offset, qint64 n_samples) const;
+	/// Tell the kernel that the given mapped memory is going to be read sequentially.
+	static void _advise_sequential(uchar *data, qint64 size);
+	/// Copy the samples into memory if they are mapped, so that they can be modified.
+	void _detach();
+	void _append_bytes(const char *bytes, qint64 size);
 
 private:
-	QByteArray _wave;
+	/// The samples, if they are held in memory.
+	std::vector<char> _buffer;
+	/// The samples, if they are mapped from _mapped_file.
+	const char *_mapped_data;
+	qint64 _mapped_size;
+	/// The file the samples are mapped from, if any. It is shared by all the copies of the wave, which share the mapping.
+	std::shared_ptr<QFile> _mapped_file;
+	/// The container the wave has been read from.
+	Container _container;
 
-	RIFF _riff;
 	FMTHDR _fmthdr;
 	FMT _fmt;
+	SampleCodec _codec;
 	std::vector<char> _fmt_extra_bytes;
 	FACT _fact;
-	DATA _data;
 	int16_t _extra_param_length;
 	std::vector<char> _extra_param;
 
@@ -0,0 +1,152 @@
+/*
+ * StageTimings.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "StageTimings.h"
+
+#include <QMutexLocker>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QDebug>
+
+#include <stdexcept>
+
+namespace cb {
+
+StageStats::StageStats() :
+				count(0),
+				total_ns(0),
+				max_ns(0),
+				last_ns(0),
+				bytes(0),
+				samples(0),
+				audio_us(0) {
+
+}
+
+qreal StageStats::realtime_factor() const {
+	if(total_ns == 0) return 0.;
+	return audio_us * 1000. / total_ns;
+}
+
+QJsonObject StageStats::to_json() const {
+	QJsonObject result;
+	result["count"] = count;
+	result["total_ms"] = total_ns / 1e6;
+	result["max_ms"] = max_ns / 1e6;
+	result["last_ms"] = last_ns / 1e6;
+	result["bytes"] = bytes;
+	result["samples"] = samples;
+	result["audio_s"] = audio_us / 1e6;
+	result["realtime_factor"] = realtime_factor();
+	result["megabytes_per_second"] = (total_ns > 0) ? bytes * 1e3 / total_ns : 0.;
+	return result;
+}
+
+StageTimings &StageTimings::shared() {
+	static StageTimings timings;
+	return timings;
+}
+
+StageTimings::StageTimings() {
+
+}
+
+StageTimings::~StageTimings() {
+
+}
+
+void StageTimings::record(const QString &stage, qint64 elapsed_ns, qint64 bytes, qint64 samples, qint64 audio_us) {
+	QMutexLocker locker(&_mutex);
+	StageStats &stats = _stats[stage];
+	stats.name = stage;
+	stats.count++;
+	stats.total_ns += elapsed_ns;
+	stats.max_ns = qMax(stats.max_ns, elapsed_ns);
+	stats.last_ns = elapsed_ns;
+	stats.bytes += bytes;
+	stats.samples += samples;
+	stats.audio_us += audio_us;
+}
+
+StageStats StageTimings::stats(const QString &stage) const {
+	QMutexLocker locker(&_mutex);
+	auto it = _stats.find(stage);
+	if(it == _stats.end()) {
+		StageStats empty;
+		empty.name = stage;
+		return empty;
+	}
+
+	return it->second;
+}
+
+std::vector<StageStats> StageTimings::all_stats() const {
+	QMutexLocker locker(&_mutex);
+	std::vector<StageStats> result;
+	for(auto &entry : _stats) {
+		result.push_back(entry.second);
+	}
+	return result;
+}
+
+void StageTimings::clear() {
+	QMutexLocker locker(&_mutex);
+	_stats.clear();
+}
+
+QJsonObject StageTimings::to_json() const {
+	QJsonObject result;
+	for(auto &stats : all_stats()) {
+		result[stats.name] = stats.to_json();
+	}
+	return result;
+}
+
+void StageTimings::dump_to_log() const {
+	for(auto &stats : all_stats()) {
+		qDebug() << qPrintable(stats.name) << "- runs:" << stats.count << "total (ms):" << stats.total_ns / 1e6 << "max (ms):" << stats.max_ns / 1e6 << "bytes:" << stats.bytes << "samples:" << stats.samples << "realtime factor:" << stats.realtime_factor();
+	}
+}
+
+void StageTimings::dump_to_file(const QString &filename) const {
+	QSaveFile file(filename);
+	if(!file.open(QIODevice::WriteOnly)) {
+		QString error = QString("Cannot open '%1' for writing").arg(filename);
+		throw std::runtime_error(error.toStdString());
+	}
+	file.write(QJsonDocument(to_json()).toJson());
+	if(!file.commit()) {
+		QString error = QString("Cannot write to '%1'").arg(filename);
+		throw std::runtime_error(error.toStdString());
+	}
+}
+
+StageTimer::StageTimer(const QString &stage) :
+				_stage(stage),
+				_bytes(0),
+				_samples(0),
+				_audio_us(0),
+				_discarded(false) {
+	_timer.start();
+}
+
+StageTimer::~StageTimer() {
+	if(!_discarded) StageTimings::shared().record(_stage, _timer.nsecsElapsed(), _bytes, _samples, _audio_us);
+}
+
+void StageTimer::set_processed(qint64 bytes, qint64 samples, qint64 audio_us) {
+	_bytes = bytes;
+	_samples = samples;
+	_audio_us = audio_us;
+}
+
+void StageTimer::discard() {
+	_discarded = true;
+}
+
+} /* namespace cb */
@@ -0,0 +1,123 @@
+/*
+ * StageTimings.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_STAGETIMINGS_H_
+#define SRC_STAGETIMINGS_H_
+
+#include <map>
+#include <vector>
+
+#include <QString>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+namespace cb {
+
+/// What has been recorded for a stage (e.g. decoding or processing) so far.
+struct StageStats {
+	StageStats();
+
+	/// Realtime factor: seconds of audio handled per second of wall time, or 0 if no audio has been handled.
+	qreal realtime_factor() const;
+	QJsonObject to_json() const;
+
+	QString name;
+	/// Number of times the stage has run.
+	int count;
+	/// Wall time (in nanoseconds) spent in the stage, in total and in the longest and most recent runs.
+	qint64 total_ns, max_ns, last_ns;
+	/// Amount of data handled by the stage, summed over all the runs.
+	qint64 bytes, samples;
+	/// Duration (in microseconds) of the audio handled by the stage, summed over all the runs.
+	qint64 audio_us;
+};
+
+/**
+ * A thread-safe collection of per-stage timings. The stages of the decode/process/export path record their
+ * timings in the instance returned by shared(), which can be queried, or dumped to the log or to a JSON file.
+ */
+class StageTimings {
+public:
+	/**
+	 * Return the instance shared by the whole program.
+	 *
+	 * @return
+	 */
+	static StageTimings &shared();
+
+	StageTimings();
+	virtual ~StageTimings();
+
+	StageTimings(StageTimings const&) = delete;
+	StageTimings& operator=(StageTimings const&) = delete;
+
+	/**
+	 * Add a run to the statistics of a stage.
+	 *
+	 * @param stage Name of the stage
+	 * @param elapsed_ns Wall time (in nanoseconds) taken by the run
+	 * @param bytes Number of bytes handled by the run
+	 * @param samples Number of samples (all channels included) handled by the run
+	 * @param audio_us Duration (in microseconds) of the audio handled by the run
+	 */
+	void record(const QString &stage, qint64 elapsed_ns, qint64 bytes, qint64 samples, qint64 audio_us);
+
+	/// Return the statistics of the given stage. If the stage has never run, its count is 0.
+	StageStats stats(const QString &stage) const;
+	/// Return the statistics of all the stages that have run, sorted by name.
+	std::vector<StageStats> all_stats() const;
+	void clear();
+
+	QJsonObject to_json() const;
+	/// Print a line per stage to the log.
+	void dump_to_log() const;
+	/**
+	 * Write the statistics to a JSON file.
+	 *
+	 * @param filename
+	 */
+	void dump_to_file(const QString &filename) const;
+
+private:
+	mutable QMutex _mutex;
+	std::map<QString, StageStats> _stats;
+};
+
+/**
+ * Measures the wall time elapsed between its construction and its destruction, and records it in
+ * StageTimings::shared() together with the amount of data set with set_processed().
+ */
+class StageTimer {
+public:
+	StageTimer(const QString &stage);
+	virtual ~StageTimer();
+
+	StageTimer(StageTimer const&) = delete;
+	StageTimer& operator=(StageTimer const&) = delete;
+
+	/**
+	 * Set the amount of data handled by the stage.
+	 *
+	 * @param bytes
+	 * @param samples Number of samples, all channels included
+	 * @param audio_us Duration of the audio (in microseconds)
+	 */
+	void set_processed(qint64 bytes, qint64 samples, qint64 audio_us);
+	/// Do not record anything (e.g. because the stage has been aborted).
+	void discard();
+
+private:
+	QString _stage;
+	QElapsedTimer _timer;
+	qint64 _bytes, _samples, _audio_us;
+	bool _discarded;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_STAGETIMINGS_H_ */
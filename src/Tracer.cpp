@@ -0,0 +1,166 @@
+/*
+ * Tracer.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#include "Tracer.h"
+
+#include <QMutexLocker>
+#include <QThread>
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+
+#include <stdexcept>
+
+namespace cb {
+
+Tracer &Tracer::shared() {
+	static Tracer tracer;
+	return tracer;
+}
+
+Tracer::Tracer() :
+				_enabled(false) {
+	_clock.start();
+}
+
+Tracer::~Tracer() {
+
+}
+
+void Tracer::start() {
+	QMutexLocker locker(&_mutex);
+	_events.clear();
+	_clock.restart();
+	_enabled = true;
+}
+
+void Tracer::stop() {
+	_enabled = false;
+}
+
+bool Tracer::is_enabled() const {
+	return _enabled;
+}
+
+qint64 Tracer::now_us() const {
+	return _clock.nsecsElapsed() / 1000;
+}
+
+void Tracer::save(const QString &filename) const {
+	QJsonArray events;
+	{
+		QMutexLocker locker(&_mutex);
+		qint64 pid = QCoreApplication::applicationPid();
+
+		for(auto &thread : _thread_names) {
+			QJsonObject args;
+			args["name"] = thread.second;
+			QJsonObject event;
+			event["name"] = "thread_name";
+			event["ph"] = "M";
+			event["pid"] = pid;
+			event["tid"] = thread.first;
+			event["args"] = args;
+			events.append(event);
+		}
+
+		for(auto &e : _events) {
+			QJsonObject event;
+			event["name"] = e.name;
+			event["cat"] = e.category;
+			event["ph"] = QString(QChar(e.phase));
+			event["ts"] = e.ts_us;
+			event["pid"] = pid;
+			event["tid"] = e.thread_id;
+			if(e.phase == 'X') event["dur"] = e.duration_us;
+			// instant events are shown on the lane of their thread
+			if(e.phase == 'i') event["s"] = "t";
+			if(!e.args.isEmpty()) event["args"] = e.args;
+			events.append(event);
+		}
+	}
+
+	QJsonObject trace;
+	trace["traceEvents"] = events;
+	trace["displayTimeUnit"] = "ms";
+
+	QSaveFile file(filename);
+	if(!file.open(QIODevice::WriteOnly)) {
+		QString error = QString("Cannot open '%1' for writing").arg(filename);
+		throw std::runtime_error(error.toStdString());
+	}
+	file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+	if(!file.commit()) {
+		QString error = QString("Cannot write to '%1'").arg(filename);
+		throw std::runtime_error(error.toStdString());
+	}
+}
+
+void Tracer::complete(const QString &category, const QString &name, qint64 start_us, qint64 duration_us, const QJsonObject &args) {
+	if(!_enabled) return;
+	_add('X', category, name, start_us, duration_us, args);
+}
+
+void Tracer::instant(const QString &category, const QString &name, const QJsonObject &args) {
+	if(!_enabled) return;
+	_add('i', category, name, now_us(), 0, args);
+}
+
+void Tracer::begin(const QString &category, const QString &name) {
+	if(!_enabled) return;
+	_add('B', category, name, now_us(), 0, QJsonObject());
+}
+
+void Tracer::end(const QString &category, const QString &name) {
+	if(!_enabled) return;
+	_add('E', category, name, now_us(), 0, QJsonObject());
+}
+
+void Tracer::_add(char phase, const QString &category, const QString &name, qint64 ts_us, qint64 duration_us, const QJsonObject &args) {
+	QMutexLocker locker(&_mutex);
+	_events.push_back(Event { phase, category, name, ts_us, duration_us, _thread_id(), args });
+}
+
+int Tracer::_thread_id() {
+	static std::atomic<int> next_id(1);
+	static thread_local int id = 0;
+
+	if(id == 0) {
+		id = next_id++;
+
+		QThread *thread = QThread::currentThread();
+		QString name = thread->objectName();
+		if(name.isEmpty()) {
+			bool is_main = QCoreApplication::instance() != nullptr && QCoreApplication::instance()->thread() == thread;
+			name = is_main ? QString("main") : QString("thread %1").arg(id);
+		}
+		_thread_names[id] = name;
+	}
+
+	return id;
+}
+
+TraceSpan::TraceSpan(const QString &category, const QString &name, const QJsonObject &args) :
+				_active(Tracer::shared().is_enabled()),
+				_start_us(0) {
+	if(_active) {
+		_category = category;
+		_name = name;
+		_args = args;
+		_start_us = Tracer::shared().now_us();
+	}
+}
+
+TraceSpan::~TraceSpan() {
+	if(_active) {
+		Tracer &tracer = Tracer::shared();
+		tracer.complete(_category, _name, _start_us, tracer.now_us() - _start_us, _args);
+	}
+}
+
+} /* namespace cb */
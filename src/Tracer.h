@@ -0,0 +1,119 @@
+/*
+ * Tracer.h
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ */
+
+#ifndef SRC_TRACER_H_
+#define SRC_TRACER_H_
+
+#include <vector>
+#include <map>
+#include <atomic>
+
+#include <QString>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+namespace cb {
+
+/**
+ * An opt-in recorder of trace events, which can be saved in the Chrome trace-event JSON format and then inspected
+ * with chrome://tracing or Perfetto. Each thread gets its own lane, named after the objectName() of its QThread.
+ *
+ * Recording is disabled by default, in which case recording an event costs a single atomic load. All the methods
+ * are thread-safe.
+ */
+class Tracer {
+public:
+	/**
+	 * Return the instance shared by the whole program.
+	 *
+	 * @return
+	 */
+	static Tracer &shared();
+
+	Tracer();
+	virtual ~Tracer();
+
+	Tracer(Tracer const&) = delete;
+	Tracer& operator=(Tracer const&) = delete;
+
+	/// Drop the events recorded so far and start recording.
+	void start();
+	/// Stop recording. The events recorded so far are kept.
+	void stop();
+	bool is_enabled() const;
+
+	/**
+	 * Write the recorded events to a file.
+	 *
+	 * @param filename
+	 */
+	void save(const QString &filename) const;
+
+	/// Microseconds elapsed since recording started.
+	qint64 now_us() const;
+
+	/**
+	 * Record an event that spans a time interval.
+	 *
+	 * @param category
+	 * @param name
+	 * @param start_us Beginning of the interval, as returned by now_us()
+	 * @param duration_us
+	 * @param args Additional information shown together with the event
+	 */
+	void complete(const QString &category, const QString &name, qint64 start_us, qint64 duration_us, const QJsonObject &args = QJsonObject());
+	/// Record an event that happens at the current time.
+	void instant(const QString &category, const QString &name, const QJsonObject &args = QJsonObject());
+	/// Record the beginning of an interval whose end will be recorded by end(), on the same thread.
+	void begin(const QString &category, const QString &name);
+	void end(const QString &category, const QString &name);
+
+private:
+	struct Event {
+		char phase;
+		QString category;
+		QString name;
+		qint64 ts_us;
+		qint64 duration_us;
+		int thread_id;
+		QJsonObject args;
+	};
+
+	void _add(char phase, const QString &category, const QString &name, qint64 ts_us, qint64 duration_us, const QJsonObject &args);
+	/// Return the id of the calling thread, registering it if required. Must be called with _mutex locked.
+	int _thread_id();
+
+	std::atomic<bool> _enabled;
+	QElapsedTimer _clock;
+	mutable QMutex _mutex;
+	std::vector<Event> _events;
+	std::map<int, QString> _thread_names;
+};
+
+/**
+ * Records, if tracing is enabled, an event spanning from its construction to its destruction.
+ */
+class TraceSpan {
+public:
+	TraceSpan(const QString &category, const QString &name, const QJsonObject &args = QJsonObject());
+	virtual ~TraceSpan();
+
+	TraceSpan(TraceSpan const&) = delete;
+	TraceSpan& operator=(TraceSpan const&) = delete;
+
+private:
+	bool _active;
+	QString _category;
+	QString _name;
+	QJsonObject _args;
+	qint64 _start_us;
+};
+
+} /* namespace cb */
+
+#endif /* SRC_TRACER_H_ */
@@ -0,0 +1,370 @@
+/*
+ * bench_main.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ *
+ * Microbenchmarks for the sample hot paths, run on synthetic signals. Results are printed as JSON, so that they can
+ * be compared between releases. The bit-exactness of the kernels that are benchmarked is tested by cretinsbar_tests.
+ *
+ * Usage: cretinsbar_bench [-s seconds] [-c channels] [-r rate] [-n repetitions] [--mp3 file] [-o output file]
+ */
+
+#include "../Engine.h"
+#include "../SoundUtils/SoundUtils.h"
+#include "../SoundUtils/Wave.h"
+#include "../SoundUtils/SampleStore.h"
+#include "../SoundUtils/SampleConversion.h"
+#include "../SoundUtils/SampleCodec.h"
+#include "../SoundUtils/Mp3Decoder.h"
+#include "../SoundUtils/Mp3Source.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <random>
+#include <cstring>
+
+using namespace cb;
+
+/// Number of samples (all channels included) handled at each step by the block-based benchmarks.
+#define BLOCK_SAMPLES 4096
+
+/**
+ * Build a 16-bit wave containing a few superimposed tones.
+ *
+ * @param seconds
+ * @param channels
+ * @param rate
+ * @return
+ */
+Wave synthetic_wave(int seconds, int channels, int rate) {
+	Wave wave(channels, rate, 16);
+
+	const int block_frames = 4096;
+	std::vector<float> block(block_frames * channels);
+	long long n_frames = (long long) seconds * rate;
+	for(long long frame = 0; frame < n_frames; frame += block_frames) {
+		int n = (int) std::min((long long) block_frames, n_frames - frame);
+		for(int i = 0; i < n; i++) {
+			double t = (frame + i) / (double) rate;
+			for(int c = 0; c < channels; c++) {
+				block[i * channels + c] = 0.3 * sin(2. * M_PI * (220. + 110. * c) * t) + 0.2 * sin(2. * M_PI * 659.25 * t) * sin(2. * M_PI * 0.5 * t);
+			}
+		}
+		wave.append_samples(block.data(), n * channels);
+	}
+
+	return wave;
+}
+
+/**
+ * Run a function several times and collect its timings.
+ *
+ * @param name Name of the benchmark
+ * @param parameters Parameters of the benchmark, copied as they are in the result
+ * @param repetitions Number of times the function is run
+ * @param n_items Number of items (e.g. samples) handled by each run, used to compute the throughput
+ * @param function
+ * @return The result of the benchmark
+ */
+QJsonObject measure(const QString &name, const QJsonObject &parameters, int repetitions, qint64 n_items, const std::function<void()> &function) {
+	std::vector<qint64> timings;
+	for(int i = 0; i < repetitions; i++) {
+		QElapsedTimer timer;
+		timer.start();
+		function();
+		timings.push_back(std::max(timer.nsecsElapsed(), (qint64) 1));
+	}
+	std::sort(timings.begin(), timings.end());
+
+	qreal sum = 0.;
+	for(auto t : timings) sum += t;
+
+	QJsonObject result;
+	result["name"] = name;
+	result["parameters"] = parameters;
+	result["repetitions"] = repetitions;
+	result["items"] = n_items;
+	result["min_ms"] = timings.front() / 1e6;
+	result["median_ms"] = timings[timings.size() / 2] / 1e6;
+	result["mean_ms"] = sum / timings.size() / 1e6;
+	result["items_per_second"] = n_items / (timings.front() / 1e9);
+
+	std::cerr << qPrintable(name) << ": " << timings.front() / 1e6 << " ms" << std::endl;
+
+	return result;
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+	app.setApplicationName("cretinsbar_bench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Benchmark the sample hot paths.");
+	parser.addHelpOption();
+	QCommandLineOption seconds_option(QStringList() << "s" << "seconds", "Length of the synthetic signal (default: 60).", "seconds", "60");
+	QCommandLineOption channels_option(QStringList() << "c" << "channels", "Number of channels of the synthetic signal (default: 2).", "channels", "2");
+	QCommandLineOption rate_option(QStringList() << "r" << "rate", "Sample rate of the synthetic signal (default: 44100).", "rate", "44100");
+	QCommandLineOption repetitions_option(QStringList() << "n" << "repetitions", "Number of runs of each benchmark (default: 5).", "repetitions", "5");
+	QCommandLineOption mp3_option("mp3", "mp3 file used to benchmark decoding. Decoding is skipped if not given.", "file");
+	QCommandLineOption output_option(QStringList() << "o" << "output", "File the results are written to (default: standard output).", "file");
+	parser.addOption(seconds_option);
+	parser.addOption(channels_option);
+	parser.addOption(rate_option);
+	parser.addOption(repetitions_option);
+	parser.addOption(mp3_option);
+	parser.addOption(output_option);
+	parser.process(app);
+
+	int seconds = parser.value(seconds_option).toInt();
+	int channels = parser.value(channels_option).toInt();
+	int rate = parser.value(rate_option).toInt();
+	int repetitions = parser.value(repetitions_option).toInt();
+	if(seconds < 1 || channels < 1 || rate < 1 || repetitions < 1) {
+		std::cerr << qPrintable(parser.helpText()) << std::endl;
+		return 1;
+	}
+
+	std::cerr << "Generating " << seconds << " s of " << channels << "-channel audio" << std::endl;
+	Wave wave = synthetic_wave(seconds, channels, rate);
+	qint64 n_samples = wave.get_n_samples();
+	QJsonArray results;
+
+	// Wave::get_samples, block by block, as done when stretching
+	results.append(measure("Wave::get_samples", QJsonObject(), repetitions, n_samples, [&wave, n_samples]() {
+		std::vector<float> block;
+		block.reserve(BLOCK_SAMPLES);
+		for(qint64 offset = 0; offset < n_samples; offset += BLOCK_SAMPLES) {
+			block.clear();
+			wave.get_samples(offset, BLOCK_SAMPLES, block);
+		}
+	}));
+
+	// the same, reading into a buffer provided by the caller
+	results.append(measure("Wave::get_samples (span)", QJsonObject(), repetitions, n_samples, [&wave, n_samples]() {
+		float block[BLOCK_SAMPLES];
+		for(qint64 offset = 0; offset < n_samples; offset += BLOCK_SAMPLES) {
+			wave.get_samples(offset, BLOCK_SAMPLES, block);
+		}
+	}));
+
+	// Wave::append_samples, block by block, as done when collecting the output of SoundTouch
+	std::vector<float> float_samples;
+	float_samples.reserve(n_samples);
+	for(qint64 offset = 0; offset < n_samples; offset += BLOCK_SAMPLES) {
+		std::vector<float> block;
+		wave.get_samples(offset, BLOCK_SAMPLES, block);
+		float_samples.insert(float_samples.end(), block.begin(), block.end());
+	}
+	results.append(measure("Wave::append_samples", QJsonObject(), repetitions, n_samples, [&wave, &float_samples]() {
+		Wave out((int) wave.get_channels(), wave.get_samples_per_sec(), wave.get_bits_per_sample());
+		for(size_t offset = 0; offset < float_samples.size(); offset += BLOCK_SAMPLES) {
+			int n = (int) std::min((size_t) BLOCK_SAMPLES, float_samples.size() - offset);
+			out.append_samples(float_samples.data() + offset, n);
+		}
+	}));
+	// the same, reserving the required memory in advance as SoundUtils::process does
+	results.append(measure("Wave::append_samples (reserved)", QJsonObject(), repetitions, n_samples, [&wave, &float_samples]() {
+		Wave out((int) wave.get_channels(), wave.get_samples_per_sec(), wave.get_bits_per_sample());
+		out.reserve_samples(float_samples.size());
+		for(size_t offset = 0; offset < float_samples.size(); offset += BLOCK_SAMPLES) {
+			int n = (int) std::min((size_t) BLOCK_SAMPLES, float_samples.size() - offset);
+			out.append_samples(float_samples.data() + offset, n);
+		}
+	}));
+
+	// the conversion kernels on their own, whole buffer at once
+	std::vector<int16_t> int_buffer(n_samples);
+	std::vector<float> float_buffer(n_samples);
+	memcpy(int_buffer.data(), wave.data(), n_samples * sizeof(int16_t));
+	for(SampleConversion::Kernel kernel : SampleConversion::supported_kernels()) {
+		QJsonObject parameters;
+		parameters["kernel"] = SampleConversion::kernel_name(kernel);
+		results.append(measure("SampleConversion::to_float", parameters, repetitions, n_samples, [kernel, &int_buffer, &float_buffer]() {
+			SampleConversion::to_float(kernel, int_buffer.data(), float_buffer.data(), int_buffer.size());
+		}));
+		results.append(measure("SampleConversion::to_int16", parameters, repetitions, n_samples, [kernel, &int_buffer, &float_buffer]() {
+			SampleConversion::to_int16(kernel, float_buffer.data(), int_buffer.data(), float_buffer.size());
+		}));
+	}
+
+	// the codecs of the other wav formats, with the channels of the synthetic signal
+	for(SampleCodec::Format format : { SampleCodec::UINT8, SampleCodec::INT24, SampleCodec::INT32, SampleCodec::FLOAT32 }) {
+		SampleCodec codec(format, channels);
+		std::vector<char> encoded(n_samples * codec.bytes_per_sample());
+		QJsonObject parameters;
+		parameters["format"] = SampleCodec::format_name(format);
+		results.append(measure("SampleCodec::encode", parameters, repetitions, n_samples, [&codec, &float_buffer, &encoded]() {
+			codec.encode(float_buffer.data(), encoded.data(), float_buffer.size());
+		}));
+		results.append(measure("SampleCodec::decode", parameters, repetitions, n_samples, [&codec, &float_buffer, &encoded]() {
+			codec.decode(encoded.data(), float_buffer.data(), float_buffer.size());
+		}));
+	}
+
+	// the conversion to floats performed once per loaded file
+	results.append(measure("SampleStore (from Wave)", QJsonObject(), repetitions, n_samples, [&wave]() {
+		SampleStore samples(wave);
+	}));
+	SampleStore samples(wave);
+
+	// Wave::bytes_from_us, one call per millisecond of audio
+	qint64 n_calls = (qint64) seconds * 1000;
+	results.append(measure("Wave::bytes_from_us", QJsonObject(), repetitions, n_calls, [&wave, n_calls]() {
+		volatile qint64 total = 0;
+		for(qint64 ms = 0; ms < n_calls; ms++) {
+			total += wave.bytes_from_us(ms * 1000);
+		}
+	}));
+
+	// SoundUtils::process over a tempo/pitch grid
+	for(int tempo_change : { -50, -25, 25 }) {
+		for(int pitch_change : { 0, 2 }) {
+			QJsonObject parameters;
+			parameters["tempo_change"] = tempo_change;
+			parameters["pitch_change"] = pitch_change;
+			results.append(measure("SoundUtils::process", parameters, repetitions, n_samples, [&samples, tempo_change, pitch_change]() {
+				SoundUtils::process(samples, tempo_change, pitch_change);
+			}));
+		}
+	}
+
+	// SoundUtils::process_parallel, as a function of the number of threads: powers of two up to the number of
+	// cores, which is always tested
+	std::vector<int> thread_counts;
+	for(int n_threads = 1; n_threads < QThread::idealThreadCount(); n_threads *= 2) thread_counts.push_back(n_threads);
+	thread_counts.push_back(QThread::idealThreadCount());
+	for(int n_threads : thread_counts) {
+		QJsonObject parameters;
+		parameters["tempo_change"] = -25;
+		parameters["threads"] = n_threads;
+		results.append(measure("SoundUtils::process_parallel", parameters, repetitions, n_samples, [&samples, n_threads]() {
+			SoundUtils::process_parallel(samples, -25.f, 0, 0, -1, n_threads);
+		}));
+	}
+
+	// the data preparation performed by WaveForm::load_wave
+	results.append(measure("SoundUtils::waveform_data", QJsonObject(), repetitions, n_samples, [&wave]() {
+		SoundUtils::waveform_data(wave);
+	}));
+
+	// mp3 decoding, if a file is given: to a 16-bit wave that is then converted to floats, as it used to be done,
+	// and straight to floats
+	if(parser.isSet(mp3_option)) {
+		QString mp3_file = parser.value(mp3_option);
+		qint64 n_decoded = Engine::decode_samples(mp3_file)->n_samples();
+		QJsonObject parameters;
+		parameters["file"] = mp3_file;
+		results.append(measure("Engine::decode (mp3)", parameters, repetitions, n_decoded, [&mp3_file]() {
+			Engine::decode(mp3_file);
+		}));
+		results.append(measure("Engine::decode + SampleStore (mp3)", parameters, repetitions, n_decoded, [&mp3_file]() {
+			SampleStore samples(*Engine::decode(mp3_file));
+		}));
+		QJsonObject sequential_parameters = parameters;
+		sequential_parameters["threads"] = 1;
+		results.append(measure("Engine::decode_samples (mp3)", sequential_parameters, repetitions, n_decoded, [&mp3_file]() {
+			Engine::decode_samples(mp3_file, 1);
+		}));
+
+		// parallel decoding, as a function of the number of threads. The result must match the sequential one, the
+		// ranges being joined sample by sample
+		std::shared_ptr<SampleStore> sequential = Mp3Decoder::decode(mp3_file, 1);
+		for(int n_threads : thread_counts) {
+			if(n_threads < 2) continue;
+			std::shared_ptr<SampleStore> parallel = Mp3Decoder::decode(mp3_file, n_threads);
+			float max_difference = (parallel->n_samples() == sequential->n_samples()) ? 0.f : std::numeric_limits<float>::infinity();
+			const float *seq = sequential->samples(0, sequential->n_samples());
+			const float *par = parallel->samples(0, parallel->n_samples());
+			for(qint64 i = 0; i < std::min(parallel->n_samples(), sequential->n_samples()); i++) {
+				max_difference = std::max(max_difference, std::abs(par[i] - seq[i]));
+			}
+
+			QJsonObject thread_parameters = parameters;
+			thread_parameters["threads"] = n_threads;
+			QJsonObject result = measure("Engine::decode_samples (mp3)", thread_parameters, repetitions, n_decoded, [&mp3_file, n_threads]() {
+				Engine::decode_samples(mp3_file, n_threads);
+			});
+			result["max_difference_from_sequential"] = max_difference;
+			result["samples_difference_from_sequential"] = parallel->n_samples() - sequential->n_samples();
+			results.append(result);
+		}
+
+		// lazy decoding: opening the file only scans it, and windows at random positions are decoded as they are read.
+		// They must match the samples decoded in one go, and the decoded blocks must stay within the budget
+		results.append(measure("Mp3Source (mp3)", parameters, repetitions, n_decoded, [&mp3_file]() {
+			Mp3Source source(mp3_file);
+		}));
+
+		Mp3Source source(mp3_file);
+		int source_channels = source.channels();
+		qint64 window_samples = std::min(source.n_samples(), (qint64) 10 * source.sample_rate() * source_channels);
+		std::vector<float> window(window_samples);
+		std::mt19937 generator(1);
+		std::uniform_int_distribution<qint64> frames(0, (source.n_samples() - window_samples) / source_channels);
+		QJsonObject window_parameters = parameters;
+		window_parameters["window_samples"] = window_samples;
+		QJsonObject result = measure("Mp3Source::read (mp3)", window_parameters, repetitions, window_samples, [&]() {
+			source.read(frames(generator) * source_channels, window_samples, window.data());
+		});
+
+		float max_difference = (source.n_samples() == sequential->n_samples()) ? 0.f : std::numeric_limits<float>::infinity();
+		for(int i = 0; i < 8 && source.n_samples() == sequential->n_samples(); i++) {
+			qint64 offset = frames(generator) * source_channels;
+			qint64 n_read = source.read(offset, window_samples, window.data());
+			const float *seq = sequential->samples(offset, n_read);
+			for(qint64 j = 0; j < n_read; j++) max_difference = std::max(max_difference, std::abs(window[j] - seq[j]));
+		}
+		result["max_difference_from_sequential"] = max_difference;
+		result["cache_size"] = source.cache_size();
+		result["cache_budget"] = source.cache_budget();
+		results.append(result);
+
+		// the overview plotted by WaveForm::load_wave for files that are decoded lazily
+		results.append(measure("SoundUtils::waveform_data (mp3 overview)", parameters, 1, n_decoded, [&source]() {
+			SoundUtils::waveform_data(source, 200000);
+		}));
+	}
+
+	QJsonObject config;
+	config["seconds"] = seconds;
+	config["channels"] = channels;
+	config["rate"] = rate;
+	config["repetitions"] = repetitions;
+	config["ideal_thread_count"] = QThread::idealThreadCount();
+	config["conversion_kernel"] = SampleConversion::kernel_name(SampleConversion::default_kernel());
+	config["mp3_float_output"] = Mp3Decoder::supports_float();
+
+	QJsonObject report;
+	report["version"] = QString::number(CRETINSBAR_VERSION);
+	report["config"] = config;
+	report["results"] = results;
+	QByteArray json = QJsonDocument(report).toJson();
+
+	if(parser.isSet(output_option)) {
+		QFile output(parser.value(output_option));
+		if(!output.open(QIODevice::WriteOnly)) {
+			std::cerr << "Cannot open '" << qPrintable(parser.value(output_option)) << "' for writing" << std::endl;
+			return 1;
+		}
+		output.write(json);
+	}
+	else std::cout << json.constData();
+
+	return 0;
+}
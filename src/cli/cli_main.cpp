@@ -0,0 +1,195 @@
+/*
+ * cli_main.cpp
+ *
+ *  Created on: 16 oct 2026
+ *      Author: lorenzo
+ *
+ * Renders tempo/pitch-changed versions of a set of audio files without any GUI, processing several files at once.
+ *
+ * Usage: cretinsbar-cli [-t tempo] [-p pitch] [-j jobs] [-o output directory] [--timings file] [--trace file] file [file ...]
+ *        cretinsbar-cli --info file [file ...]
+ */
+
+#include "../Engine.h"
+#include "../StageTimings.h"
+#include "../Tracer.h"
+#include "../SoundUtils/SoundUtils.h"
+#include "../SoundUtils/Wave.h"
+#include "../SoundUtils/SampleStore.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QFileInfo>
+#include <QDir>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include <iostream>
+#include <atomic>
+
+using namespace cb;
+
+/// Serialises the output of the jobs.
+static QMutex output_mutex;
+
+/**
+ * Decodes, processes and saves a single file.
+ */
+class RenderJob: public QRunnable {
+public:
+	RenderJob(const QString &input, const QString &output, qreal tempo_change, int pitch_change, int n_threads, std::atomic<int> &n_failed) :
+					_input(input),
+					_output(output),
+					_tempo_change(tempo_change),
+					_pitch_change(pitch_change),
+					_n_threads(n_threads),
+					_n_failed(n_failed) {
+
+	}
+
+	virtual void run() {
+		try {
+			std::shared_ptr<SampleStore> samples = Engine::decode_samples(_input, _n_threads);
+			std::unique_ptr<Wave> result = SoundUtils::process_parallel(*samples, _tempo_change, _pitch_change, 0, -1, _n_threads);
+			result->save(_output);
+
+			QMutexLocker locker(&output_mutex);
+			std::cerr << qPrintable(_input) << " -> " << qPrintable(_output) << std::endl;
+		}
+		catch(std::exception &e) {
+			_n_failed++;
+			QMutexLocker locker(&output_mutex);
+			std::cerr << qPrintable(_input) << ": " << e.what() << std::endl;
+		}
+	}
+
+private:
+	QString _input;
+	QString _output;
+	qreal _tempo_change;
+	int _pitch_change;
+	int _n_threads;
+	std::atomic<int> &_n_failed;
+};
+
+/**
+ * Build the name of the rendered file: the input base name followed by the tempo and pitch, in the given directory
+ * or next to the input file.
+ */
+QString output_filename(const QString &input, const QString &output_dir, int tempo, int pitch_change) {
+	QFileInfo info(input);
+	QString name = QString("%1_t%2_p%3.wav").arg(info.completeBaseName()).arg(tempo).arg(pitch_change);
+	QDir dir(output_dir.isEmpty() ? info.absolutePath() : output_dir);
+	return dir.filePath(name);
+}
+
+/**
+ * Print the format and the duration of wav files, reading only their headers.
+ *
+ * @param inputs
+ * @return The exit code: 0 if all the files could be read, 1 otherwise
+ */
+int print_info(const QStringList &inputs) {
+	int result = 0;
+	for(auto &input : inputs) {
+		try {
+			Wave::Info info = Wave::probe(input);
+			const char *containers[] = { "RIFF", "RF64", "Wave64" };
+			std::cout << qPrintable(input) << ": " << containers[info.container] << ", " << info.format.channelCount() << " channels, " << info.format.sampleRate() << " Hz, " << info.format.sampleSize() << " bit, " << info.duration_us / 1e6 << " s" << std::endl;
+		}
+		catch(std::exception &e) {
+			std::cerr << qPrintable(input) << ": " << e.what() << std::endl;
+			result = 1;
+		}
+	}
+	return result;
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+	app.setApplicationName("cretinsbar-cli");
+	app.setApplicationVersion(QString::number(CRETINSBAR_VERSION));
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Render tempo/pitch-changed versions of audio files.");
+	parser.addHelpOption();
+	parser.addVersionOption();
+	QCommandLineOption tempo_option(QStringList() << "t" << "tempo", "Tempo, as a percentage of the original one (default: 100).", "tempo", "100");
+	QCommandLineOption pitch_option(QStringList() << "p" << "pitch", "Pitch change, in semitones (default: 0).", "pitch", "0");
+	QCommandLineOption jobs_option(QStringList() << "j" << "jobs", "Number of files processed at the same time (default: number of cores).", "jobs", QString::number(QThread::idealThreadCount()));
+	QCommandLineOption output_option(QStringList() << "o" << "output-dir", "Directory where the rendered files are saved (default: next to the input files).", "directory");
+	parser.addOption(tempo_option);
+	parser.addOption(pitch_option);
+	parser.addOption(jobs_option);
+	QCommandLineOption timings_option("timings", "Write the time spent in each stage (decoding, processing, etc.) to the given JSON file.", "file");
+	parser.addOption(output_option);
+	QCommandLineOption trace_option("trace", "Record a trace of the whole run and write it to the given file, in the Chrome trace-event format.", "file");
+	parser.addOption(timings_option);
+	parser.addOption(trace_option);
+	QCommandLineOption info_option("info", "Print the format and the duration of the given wav files instead of rendering them.");
+	parser.addOption(info_option);
+	parser.addPositionalArgument("files", "Input files (wav or mp3).", "file [file ...]");
+	parser.process(app);
+
+	bool tempo_ok, pitch_ok, jobs_ok;
+	int tempo = parser.value(tempo_option).toInt(&tempo_ok);
+	int pitch_change = parser.value(pitch_option).toInt(&pitch_ok);
+	int n_jobs = parser.value(jobs_option).toInt(&jobs_ok);
+	QStringList inputs = parser.positionalArguments();
+	if(!tempo_ok || tempo <= 0 || !pitch_ok || !jobs_ok || n_jobs < 1 || inputs.isEmpty()) {
+		std::cerr << qPrintable(parser.helpText()) << std::endl;
+		return 1;
+	}
+
+	if(parser.isSet(info_option)) return print_info(inputs);
+
+	QString output_dir = parser.value(output_option);
+	if(!output_dir.isEmpty() && !QDir(output_dir).mkpath(".")) {
+		std::cerr << "Cannot create the output directory '" << qPrintable(output_dir) << "'" << std::endl;
+		return 1;
+	}
+
+	if(parser.isSet(trace_option)) Tracer::shared().start();
+
+	// the cores are shared among the files that are processed at the same time
+	int threads_per_job = std::max(1, QThread::idealThreadCount() / n_jobs);
+	std::atomic<int> n_failed(0);
+
+	QThreadPool pool;
+	pool.setMaxThreadCount(n_jobs);
+	for(auto &input : inputs) {
+		QString output = output_filename(input, output_dir, tempo, pitch_change);
+		pool.start(new RenderJob(input, output, tempo - 100., pitch_change, threads_per_job, n_failed));
+	}
+	pool.waitForDone();
+
+	if(parser.isSet(trace_option)) {
+		Tracer::shared().stop();
+		try {
+			Tracer::shared().save(parser.value(trace_option));
+		}
+		catch(std::exception &e) {
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
+	if(parser.isSet(timings_option)) {
+		try {
+			StageTimings::shared().dump_to_file(parser.value(timings_option));
+		}
+		catch(std::exception &e) {
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
+	if(n_failed > 0) {
+		std::cerr << n_failed << " out of " << inputs.size() << " files could not be rendered" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
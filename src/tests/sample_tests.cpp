@@ -0,0 +1,181 @@
+/*
+ * sample_tests.cpp
+ *
+ *  Created on: 17 oct 2026
+ *      Author: lorenzo
+ *
+ * Bit-exactness tests of the sample conversions and codecs, registered with ctest. Every conversion kernel supported
+ * by the CPU is checked against the scalar loops that Wave used before the kernels were introduced, and the codecs
+ * of the wav sample formats against their generic loops.
+ *
+ * Usage: cretinsbar_tests
+ */
+
+#include "../SoundUtils/SampleConversion.h"
+#include "../SoundUtils/SampleCodec.h"
+
+#include <iostream>
+#include <vector>
+#include <limits>
+#include <random>
+#include <cstring>
+
+using namespace cb;
+
+/// Copy of Wave::_saturate(), as it was before the conversion kernels.
+int baseline_saturate(float fvalue, float minval, float maxval) {
+	if(fvalue > maxval) fvalue = maxval;
+	else if(fvalue < minval) fvalue = minval;
+	return (int) fvalue;
+}
+
+/// Copy of the 16-bit loop of Wave::get_samples(), as it was before the conversion kernels.
+void baseline_to_float(const std::vector<int16_t> &in, std::vector<float> &samples) {
+	const short *data_short = in.data();
+	double conv = 1.0 / 32768.0;
+	for(uint i = 0; i < in.size(); i++) {
+		short value_s = data_short[i];
+		float value_f = (float) (value_s * conv);
+		samples.push_back(value_f);
+	}
+}
+
+/// Copy of the 16-bit loop of Wave::append_samples(const float *, int), as it was before the conversion kernels.
+void baseline_to_int16(const std::vector<float> &samples, std::vector<int16_t> &out) {
+	out.resize(samples.size());
+	short *data_s = out.data();
+	for(int i = 0; i < (int) samples.size(); i++) {
+		float value_f = samples[i];
+		short value_s = (short) baseline_saturate(value_f * 32768.0f, -32768.0f, 32767.0f);
+		data_s[i] = value_s;
+	}
+}
+
+/**
+ * Check that all the supported conversion kernels give exactly the same results as the baseline scalar loops, on
+ * every 16-bit value and on floats within, at and beyond the boundaries of the 16-bit range. The conversions are
+ * performed at different alignments, so that the vectorised loops and their scalar tails are both exercised.
+ *
+ * NaNs are left out, since the baseline converted them with an undefined cast: see check_nan().
+ *
+ * @return true if all the kernels are bit-exact
+ */
+bool check_conversions() {
+	std::vector<int16_t> int_samples;
+	for(int value = -32768; value <= 32767; value++) int_samples.push_back(value);
+
+	std::vector<float> float_samples = { 0.f, -0.f, 1.f, -1.f, 32767.f / 32768.f, 32767.5f / 32768.f, -32768.5f / 32768.f, 0.5f / 32768.f, -0.5f / 32768.f, 1e-9f, -1e-9f, 2.f, -2.f, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<float> distribution(-1.5f, 1.5f);
+	for(int i = 0; i < 100000; i++) float_samples.push_back(distribution(generator));
+
+	std::vector<float> expected_floats;
+	baseline_to_float(int_samples, expected_floats);
+	std::vector<int16_t> expected_ints;
+	baseline_to_int16(float_samples, expected_ints);
+
+	bool ok = true;
+	for(SampleConversion::Kernel kernel : SampleConversion::supported_kernels()) {
+		for(size_t offset = 0; offset < 8; offset++) {
+			std::vector<float> floats(int_samples.size() - offset);
+			SampleConversion::to_float(kernel, int_samples.data() + offset, floats.data(), floats.size());
+			if(memcmp(floats.data(), expected_floats.data() + offset, floats.size() * sizeof(float)) != 0) {
+				std::cerr << "SampleConversion::to_float (" << SampleConversion::kernel_name(kernel) << ", offset " << offset << ") is not bit-exact" << std::endl;
+				ok = false;
+			}
+
+			std::vector<int16_t> ints(float_samples.size() - offset);
+			SampleConversion::to_int16(kernel, float_samples.data() + offset, ints.data(), ints.size());
+			if(memcmp(ints.data(), expected_ints.data() + offset, ints.size() * sizeof(int16_t)) != 0) {
+				std::cerr << "SampleConversion::to_int16 (" << SampleConversion::kernel_name(kernel) << ", offset " << offset << ") is not bit-exact" << std::endl;
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
+
+/**
+ * Check that NaNs are converted to 0 by all the kernels, wherever they are in a block. This is a change from the
+ * baseline, whose cast of NaNs to int was undefined.
+ *
+ * @return true if all the kernels zero NaNs
+ */
+bool check_nan() {
+	const size_t n_samples = 67;
+	bool ok = true;
+	for(SampleConversion::Kernel kernel : SampleConversion::supported_kernels()) {
+		for(size_t position = 0; position < n_samples; position++) {
+			std::vector<float> float_samples(n_samples, 0.25f);
+			float_samples[position] = std::numeric_limits<float>::quiet_NaN();
+			std::vector<int16_t> ints(n_samples);
+			SampleConversion::to_int16(kernel, float_samples.data(), ints.data(), n_samples);
+			if(ints[position] != 0 || (position > 0 && ints[position - 1] != 8192)) {
+				std::cerr << "SampleConversion::to_int16 (" << SampleConversion::kernel_name(kernel) << ", position " << position << ") does not convert NaNs to 0" << std::endl;
+				ok = false;
+			}
+		}
+	}
+
+	return ok;
+}
+
+/**
+ * Check the sample codecs of the wav formats: the loops specialised for a given number of channels must give the
+ * same bytes and the same floats as the generic one, and the integer formats must give back the samples they have
+ * been decoded from.
+ *
+ * @return true if all the codecs are consistent
+ */
+bool check_codecs() {
+	std::vector<float> float_samples = { 0.f, -0.f, 1.f, -1.f, 0.5f, -0.5f, 1e-9f, -1e-9f, 2.f, -2.f, std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN() };
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<float> distribution(-1.5f, 1.5f);
+	// an odd number of samples, so that the stereo loops leave a sample out of their frames
+	for(int i = 0; i < 100001; i++) float_samples.push_back(distribution(generator));
+	qint64 n_samples = float_samples.size();
+
+	bool ok = true;
+	for(SampleCodec::Format format : { SampleCodec::UINT8, SampleCodec::INT16, SampleCodec::INT24, SampleCodec::INT32, SampleCodec::FLOAT32 }) {
+		int bytes = SampleCodec::bytes_per_sample(format);
+		SampleCodec reference(format, 1);
+		std::vector<char> expected_bytes(n_samples * bytes);
+		reference.encode(float_samples.data(), expected_bytes.data(), n_samples);
+		std::vector<float> expected_floats(n_samples);
+		reference.decode(expected_bytes.data(), expected_floats.data(), n_samples);
+
+		for(int channels : { 2, 3 }) {
+			SampleCodec codec(format, channels);
+			std::vector<char> encoded(n_samples * bytes);
+			codec.encode(float_samples.data(), encoded.data(), n_samples);
+			std::vector<float> decoded(n_samples);
+			codec.decode(expected_bytes.data(), decoded.data(), n_samples);
+			if(encoded != expected_bytes || memcmp(decoded.data(), expected_floats.data(), n_samples * sizeof(float)) != 0) {
+				std::cerr << "SampleCodec (" << SampleCodec::format_name(format) << ", " << channels << " channels) differs from the generic codec" << std::endl;
+				ok = false;
+			}
+		}
+
+		std::vector<char> round_trip(n_samples * bytes);
+		reference.encode(expected_floats.data(), round_trip.data(), n_samples);
+		if(format != SampleCodec::FLOAT32 && round_trip != expected_bytes) {
+			std::cerr << "SampleCodec (" << SampleCodec::format_name(format) << ") does not give back the decoded samples" << std::endl;
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+int main() {
+	bool conversions = check_conversions();
+	bool nan = check_nan();
+	bool codecs = check_codecs();
+
+	std::cerr << "conversions: " << (conversions ? "ok" : "FAILED") << std::endl;
+	std::cerr << "nan: " << (nan ? "ok" : "FAILED") << std::endl;
+	std::cerr << "codecs: " << (codecs ? "ok" : "FAILED") << std::endl;
+
+	return (conversions && nan && codecs) ? 0 : 1;
+}